@@ -0,0 +1,516 @@
+/**
+ * Benchmarks for the building blocks of the indexer program.
+ *
+ * Usage: ./BENCH [name...]
+ * Runs the named benchmarks, or all of them when no name is given:
+ * newline: Newline search throughput of each supported instruction set over short records.
+ * sort: std::sort over IndexEntry objects against radix sort over packed entries, for key lengths 4, 8, 16 and 32,
+ *       on one thread and on all cores.
+ * lookup: Build time, index size, and point lookup latency and index file reads per lookup for each index layout,
+ *         with the index file dropped from the page cache before every lookup (cold) and left cached (warm). The
+ *         Eytzinger, table and columnar layouts are searched in a mapping, so they make no reads. The learned layout is
+ *         compared with the binary search of the flat layout over the same entries. The hash layout probes its
+ *         mapped hash function and reads one entry. The mapped layouts are also measured with aligned entries. The
+ *         index files are written to $TMPDIR, or /tmp.
+ * filter: Lookup latency and reads for absent keys in the flat layout without and with the key filter, and the
+ *         false positive rate each filter size achieves.
+ * cover: Latency of searches printing a part of the record in the paged layout, reading the record from the data
+ *        file against reading the projection stored in a covering index, with both files dropped from the page
+ *        cache before every search (cold) and left cached (warm).
+ * mapped: Warm point lookups per second on one core in the sorted layouts, reading the index file at every lookup
+ *         against searching it in place in a mapping of the whole file.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "format.h"
+#include "newline.h"
+#include "projection.h"
+#include "reader.h"
+#include "sort.h"
+#include "writer.h"
+
+namespace {
+
+/**
+ * Seconds elapsed since a starting point.
+ */
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Build a block of newline-terminated records with lengths spread like those in 9679310.txt.
+ */
+std::string makeRecords(size_t size) {
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> recordLength(20, 60);
+    std::string records;
+    records.reserve(size);
+    while (records.size() < size) {
+        records.append(static_cast<size_t>(recordLength(random)), 'x');
+        records.push_back('\n');
+    }
+    records.resize(size);
+    return records;
+}
+
+/**
+ * Measure each newline search implementation over 64 KiB blocks, the block size used by the scanner.
+ */
+void benchNewline() {
+    const size_t kDataSize = 256 << 20;
+    const size_t kBlockSize = 64 * 1024;
+    const int kRounds = 8;
+    std::string records = makeRecords(kDataSize);
+    std::vector<uint32_t> positions(kBlockSize);
+
+    std::cout << "newline search, " << (kDataSize >> 20) << " MiB of 20-60 byte records" << std::endl;
+
+    // Reference: one memchr call per record, as the scanner did before
+    size_t expected = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+        expected = 0;
+        const char* end = records.data() + records.size();
+        for (const char* p = records.data(); p < end; ) {
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (newline == nullptr) {
+                break;
+            }
+            ++expected;
+            p = newline + 1;
+        }
+    }
+    double seconds = secondsSince(start);
+    std::cout << "  " << std::setw(8) << "memchr" << std::fixed << std::setprecision(2)
+              << std::setw(8) << kDataSize * kRounds / seconds / 1e9 << " GB/s" << std::endl;
+
+    for (const auto& scanner : supportedNewlineScanners()) {
+        size_t found = 0;
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < kRounds; ++round) {
+            found = 0;
+            for (size_t offset = 0; offset < records.size(); offset += kBlockSize) {
+                found += scanner.find(records.data() + offset, std::min(kBlockSize, records.size() - offset), positions.data());
+            }
+        }
+        seconds = secondsSince(start);
+        std::cout << "  " << std::setw(8) << scanner.name << std::setw(8) << kDataSize * kRounds / seconds / 1e9 << " GB/s"
+                  << (found == expected ? "" : "  MISMATCH") << std::endl;
+    }
+}
+
+/**
+ * Build index entries with random alphanumeric keys for records of 39 bytes and a newline, as a scan would produce them.
+ * With `unique`, keys drawn more than once are drawn again until every key is different, as the hash layout needs.
+ */
+std::vector<IndexEntry> makeEntries(size_t count, size_t keyLength, bool unique = false) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> symbol(0, sizeof(kAlphabet) - 2);
+    std::vector<IndexEntry> entries(count);
+    for (size_t i = 0; i < count; ++i) {
+        entries[i].key.resize(keyLength);
+        for (size_t j = 0; j < keyLength; ++j) {
+            entries[i].key[j] = kAlphabet[symbol(random)];
+        }
+        entries[i].offset = static_cast<std::streamoff>(i * 40);
+    }
+
+    for (bool repeated = unique; repeated; ) {
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].key < entries[b].key; });
+        repeated = false;
+        for (size_t i = 1; i < count; ++i) {
+            if (entries[order[i]].key == entries[order[i - 1]].key) {
+                for (size_t j = 0; j < keyLength; ++j) {
+                    entries[order[i]].key[j] = kAlphabet[symbol(random)];
+                }
+                repeated = true;
+            }
+        }
+    }
+    return entries;
+}
+
+/**
+ * Compare std::sort with compareIndexEntries against radixSortEntries on the same entries.
+ */
+void benchSort() {
+    const size_t kCount = 4 << 20;
+    const size_t kKeyLengths[] = {4, 8, 16, 32};
+    const size_t threads = std::max(2u, std::thread::hardware_concurrency());
+
+    std::cout << "sort, " << (kCount >> 20) << "M entries" << std::endl;
+    for (size_t keyLength : kKeyLengths) {
+        std::vector<IndexEntry> entries = makeEntries(kCount, keyLength);
+        std::vector<char> packed = packIndexEntries(entries, keyLength);
+        std::vector<char> parallelPacked = packed;
+
+        auto start = std::chrono::steady_clock::now();
+        std::sort(entries.begin(), entries.end(), compareIndexEntries);
+        double comparisonSeconds = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        radixSortEntries(packed.data(), kCount, keyLength);
+        double radixSeconds = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        radixSortEntries(parallelPacked.data(), kCount, keyLength, threads);
+        double parallelSeconds = secondsSince(start);
+
+        bool same = packIndexEntries(entries, keyLength) == packed && packed == parallelPacked;
+        std::cout << "  key " << std::setw(2) << keyLength << std::fixed << std::setprecision(0)
+                  << "  std::sort " << std::setw(5) << comparisonSeconds * 1e3 << " ms"
+                  << "  radix " << std::setw(5) << radixSeconds * 1e3 << " ms"
+                  << "  radix x" << threads << " " << std::setw(5) << parallelSeconds * 1e3 << " ms"
+                  << (same ? "" : "  MISMATCH") << std::endl;
+    }
+}
+
+/**
+ * Write an index file of the entries in the given layout.
+ */
+bool writeBenchIndex(const std::string& filename, const std::vector<IndexEntry>& entries, size_t keyLength, IndexLayout layout, size_t pageSize,
+                     uint32_t filterBitsPerKey = 0, bool aligned = false, const Projection* projection = nullptr, const std::string* data = nullptr) {
+    ExternalSorter sorter(keyLength, entries.size() * entryStride(keyLength), filename + ".run", entries.size(), 1);
+    for (const auto& entry : entries) {
+        sorter.add(entry.key.data(), entry.offset, 39);
+    }
+    std::fstream indexFile(filename, std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    IndexHeader header = makeIndexHeader(keyLength, layout);
+    header.pageSize = static_cast<uint32_t>(pageSize);
+    header.offsetWidth = offsetWidthFor(static_cast<std::streamoff>(entries.size() * 40));
+    header.lengthWidth = lengthWidthFor(sorter.maxRecordLength());
+    header.filterBitsPerKey = filterBitsPerKey;
+    if (aligned) {
+        alignIndexEntries(header);
+    }
+    if (projection != nullptr) {
+        header.projection = *projection;
+    }
+    return indexFile && writeIndex(indexFile, sorter, header, data != nullptr ? data->data() : nullptr, data != nullptr ? data->size() : 0);
+}
+
+/**
+ * Time point lookups of existing keys in each layout, cold and warm.
+ */
+void benchLookup() {
+    const size_t kCount = 4 << 20;
+    const size_t kKeyLength = 8;
+    const size_t kLookups = 2000;
+    const IndexLayout kLayouts[] = {kFlatLayout, kPagedLayout, kBTreeLayout, kBTreeLayout, kEytzingerLayout, kEytzingerLayout,
+                                    kLearnedLayout, kHashLayout, kTableLayout, kTableLayout, kColumnarLayout};
+    const size_t kPageSizes[] = {0, 4096, 4096, 16384, 0, 0, 0, 0, 0, 0, 0};
+    const bool kAligned[] = {false, false, false, false, false, true, false, false, false, true, false};
+    const char* kLayoutNames[] = {"flat", "paged", "btree4K", "btree16K", "eytzinger", "eytzinger aligned", "learned", "hash", "table", "table aligned",
+                                  "columnar"};
+    const size_t kLayoutCount = sizeof(kLayouts) / sizeof(kLayouts[0]);
+
+    const char* directory = std::getenv("TMPDIR");
+    std::string filename = std::string(directory != nullptr ? directory : "/tmp") + "/bench-lookup.idx";
+    std::vector<IndexEntry> entries = makeEntries(kCount, kKeyLength, true);
+    std::mt19937 random(11);
+    std::uniform_int_distribution<size_t> pick(0, kCount - 1);
+    std::vector<size_t> targets(kLookups);
+    for (auto& target : targets) {
+        target = pick(random);
+    }
+
+    std::cout << "lookup, " << (kCount >> 20) << "M entries, key " << kKeyLength << ", " << kLookups << " lookups" << std::endl;
+    for (size_t layout = 0; layout < kLayoutCount; ++layout) {
+        IndexReader index;
+        auto start = std::chrono::steady_clock::now();
+        if (!writeBenchIndex(filename, entries, kKeyLength, kLayouts[layout], kPageSizes[layout], 0, kAligned[layout]) || !index.open(filename)) {
+            std::cerr << "Error writing " << filename << "." << std::endl;
+            return;
+        }
+        double buildSeconds = secondsSince(start);
+        int fd = open(filename.c_str(), O_RDONLY);
+        fsync(fd);
+        std::cout << "  " << std::setw(17) << kLayoutNames[layout] << " build " << std::fixed << std::setprecision(0)
+                  << std::setw(7) << buildSeconds * 1e3 << " ms " << std::setprecision(1) << std::setw(7)
+                  << static_cast<double>(lseek(fd, 0, SEEK_END)) / (1 << 20) << " MiB" << std::endl;
+
+        for (int cold = 1; cold >= 0; --cold) {
+            size_t readsBefore = index.readCount();
+            size_t misses = 0;
+            double seconds = 0;
+            for (size_t target : targets) {
+                if (cold) {
+                    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                }
+                std::streamoff offset = -1;
+                uint32_t length = 0;
+                auto start = std::chrono::steady_clock::now();
+                bool found = index.find(entries[target].key, offset, length);
+                seconds += secondsSince(start);
+                misses += !found || entries[static_cast<size_t>(offset / 40)].key != entries[target].key;
+            }
+            std::cout << "  " << std::setw(17) << kLayoutNames[layout] << (cold ? " cold " : " warm ") << std::fixed
+                      << std::setprecision(1) << std::setw(8) << seconds / kLookups * 1e6 << " us/lookup "
+                      << std::setw(5) << static_cast<double>(index.readCount() - readsBefore) / kLookups << " reads/lookup"
+                      << (misses == 0 ? "" : "  MISMATCH") << std::endl;
+        }
+        close(fd);
+    }
+    std::remove(filename.c_str());
+}
+
+/**
+ * Time lookups of absent keys in the flat layout, the binary search of the whole index, without a key filter and
+ * with filters of several false positive rates, and measure the rate each filter achieves: the share of lookups
+ * that read more than the filter block.
+ */
+void benchFilter() {
+    const size_t kCount = 4 << 20;
+    const size_t kKeyLength = 8;
+    const size_t kLookups = 2000;
+    const size_t kRateLookups = 200000;
+    const double kRates[] = {0, 0.01, 0.001};
+
+    const char* directory = std::getenv("TMPDIR");
+    std::string filename = std::string(directory != nullptr ? directory : "/tmp") + "/bench-filter.idx";
+    std::vector<IndexEntry> entries = makeEntries(kCount, kKeyLength);
+
+    // Keys ending in a lowercase letter never occur among the generated keys, and spread over the whole index
+    std::vector<IndexEntry> others = makeEntries(kRateLookups, kKeyLength);
+    std::vector<std::string> absent;
+    for (auto& other : others) {
+        other.key[kKeyLength - 1] = static_cast<char>('a' + static_cast<unsigned char>(other.key[0]) % 26);
+        absent.push_back(other.key);
+    }
+
+    std::cout << "filter, " << (kCount >> 20) << "M entries, key " << kKeyLength << ", flat, absent keys" << std::endl;
+    for (double rate : kRates) {
+        uint32_t bitsPerKey = rate > 0 ? filterBitsPerKey(rate) : 0;
+        IndexReader index;
+        if (!writeBenchIndex(filename, entries, kKeyLength, kFlatLayout, 0, bitsPerKey) || !index.open(filename)) {
+            std::cerr << "Error writing " << filename << "." << std::endl;
+            return;
+        }
+        int fd = open(filename.c_str(), O_RDONLY);
+        fsync(fd);
+
+        for (int cold = 1; cold >= 0; --cold) {
+            size_t readsBefore = index.readCount();
+            double seconds = 0;
+            for (size_t i = 0; i < kLookups; ++i) {
+                if (cold) {
+                    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                }
+                std::streamoff offset;
+                uint32_t length;
+                auto start = std::chrono::steady_clock::now();
+                index.find(absent[i], offset, length);
+                seconds += secondsSince(start);
+            }
+            std::cout << "  rate " << std::setw(5) << rate << (cold ? " cold " : " warm ") << std::fixed
+                      << std::setprecision(1) << std::setw(8) << seconds / kLookups * 1e6 << " us/lookup "
+                      << std::setw(5) << static_cast<double>(index.readCount() - readsBefore) / kLookups << " reads/lookup"
+                      << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+
+        if (bitsPerKey > 0) {
+            size_t passed = 0;
+            for (const auto& key : absent) {
+                std::streamoff offset;
+                uint32_t length;
+                size_t readsBefore = index.readCount();
+                index.find(key, offset, length);
+                passed += index.readCount() - readsBefore > 1;
+            }
+            std::cout << "  rate " << std::setw(5) << rate << " measured " << std::setprecision(4) << static_cast<double>(passed) / kRateLookups << ", "
+                      << bitsPerKey << " bits/key" << std::endl;
+        }
+        close(fd);
+    }
+    std::remove(filename.c_str());
+}
+
+/**
+ * Time searches for the bytes of a record after its key, reading the record from the data file with the offset and
+ * length of its entry, and reading the projection stored in the entry of a covering index.
+ */
+void benchCover() {
+    const size_t kCount = 1 << 20;
+    const size_t kKeyLength = 8;
+    const size_t kLookups = 2000;
+
+    const char* directory = std::getenv("TMPDIR");
+    std::string prefix = std::string(directory != nullptr ? directory : "/tmp") + "/bench-cover";
+    std::string dataFilename = prefix + ".txt";
+    std::string indexFilename = prefix + ".idx";
+
+    // Records of the key, a comma and 30 bytes, 40 bytes apart as makeEntries places them
+    std::vector<IndexEntry> entries = makeEntries(kCount, kKeyLength);
+    std::string data;
+    data.reserve(kCount * 40);
+    for (const auto& entry : entries) {
+        data += entry.key;
+        data += ',';
+        for (int i = 0; i < 30; ++i) {
+            data += static_cast<char>('a' + (entry.key[i % kKeyLength] + i) % 26);
+        }
+        data += '\n';
+    }
+    std::ofstream dataFile(dataFilename, std::ofstream::binary | std::ofstream::trunc);
+    dataFile.write(data.data(), static_cast<std::streamsize>(data.size()));
+    dataFile.close();
+
+    Projection projection;
+    std::mt19937 random(13);
+    std::uniform_int_distribution<size_t> pick(0, kCount - 1);
+    std::vector<size_t> targets(kLookups);
+    for (auto& target : targets) {
+        target = pick(random);
+    }
+
+    std::cout << "cover, " << (kCount >> 20) << "M records of 40 bytes, key " << kKeyLength << ", paged, bytes 10-39" << std::endl;
+    for (int covering = 0; covering <= 1; ++covering) {
+        IndexReader index;
+        if (!parseProjection("10-39", kByteProjection, '\t', 0, projection) ||
+            !writeBenchIndex(indexFilename, entries, kKeyLength, kPagedLayout, kIndexPageSize, 0, false, covering ? &projection : nullptr, &data) ||
+            !index.open(indexFilename)) {
+            std::cerr << "Error writing " << indexFilename << "." << std::endl;
+            return;
+        }
+        int indexFd = open(indexFilename.c_str(), O_RDONLY);
+        int dataFd = open(dataFilename.c_str(), O_RDONLY);
+        fsync(indexFd);
+        fsync(dataFd);
+
+        for (int cold = 1; cold >= 0; --cold) {
+            size_t mismatches = 0;
+            double seconds = 0;
+            std::string record, projected;
+            for (size_t target : targets) {
+                if (cold) {
+                    posix_fadvise(indexFd, 0, 0, POSIX_FADV_DONTNEED);
+                    posix_fadvise(dataFd, 0, 0, POSIX_FADV_DONTNEED);
+                }
+                auto start = std::chrono::steady_clock::now();
+                const char* entry = index.findEntry(entries[target].key);
+                if (entry != nullptr && covering) {
+                    loadStoredPayload(entry, index.header(), projected);
+                } else if (entry != nullptr) {
+                    record.resize(loadStoredRecordLength(entry, index.header()));
+                    if (pread(dataFd, &record[0], record.size(), static_cast<off_t>(loadStoredOffset(entry, index.header()))) < 0) {
+                        record.clear();
+                    }
+                    projectRecord(record.data(), record.size(), projection, projected);
+                }
+                seconds += secondsSince(start);
+                mismatches += entry == nullptr || projected != data.substr(target * 40 + 9, 30);
+            }
+            std::cout << "  " << std::setw(8) << (covering ? "covering" : "record") << (cold ? " cold " : " warm ") << std::fixed
+                      << std::setprecision(1) << std::setw(8) << seconds / kLookups * 1e6 << " us/search"
+                      << (mismatches == 0 ? "" : "  MISMATCH") << std::endl;
+        }
+        close(indexFd);
+        close(dataFd);
+    }
+    std::remove(indexFilename.c_str());
+    std::remove(dataFilename.c_str());
+}
+
+/**
+ * Time many warm lookups of existing keys in the sorted layouts, with the index read and mapped.
+ */
+void benchMapped() {
+    const size_t kCount = 4 << 20;
+    const size_t kKeyLength = 8;
+    const size_t kLookups = 1 << 21;
+    const IndexLayout kLayouts[] = {kFlatLayout, kPagedLayout, kBTreeLayout, kFrontCodedLayout, kLearnedLayout, kEytzingerLayout, kColumnarLayout};
+    const size_t kPageSizes[] = {0, 4096, 4096, 0, 0, 0, 0};
+    const char* kLayoutNames[] = {"flat", "paged", "btree4K", "front", "learned", "eytzinger", "columnar"};
+    const size_t kLayoutCount = sizeof(kLayouts) / sizeof(kLayouts[0]);
+
+    const char* directory = std::getenv("TMPDIR");
+    std::string filename = std::string(directory != nullptr ? directory : "/tmp") + "/bench-mapped.idx";
+    std::vector<IndexEntry> entries = makeEntries(kCount, kKeyLength);
+    std::mt19937 random(13);
+    std::uniform_int_distribution<size_t> pick(0, kCount - 1);
+    std::vector<size_t> targets(kLookups);
+    for (auto& target : targets) {
+        target = pick(random);
+    }
+
+    std::cout << "mapped, " << (kCount >> 20) << "M entries, key " << kKeyLength << ", " << kLookups << " warm lookups" << std::endl;
+    for (size_t layout = 0; layout < kLayoutCount; ++layout) {
+        if (!writeBenchIndex(filename, entries, kKeyLength, kLayouts[layout], kPageSizes[layout])) {
+            std::cerr << "Error writing " << filename << "." << std::endl;
+            return;
+        }
+        for (int mapped = 0; mapped <= 1; ++mapped) {
+            IndexReader index;
+            if (!index.open(filename, mapped != 0)) {
+                return;
+            }
+            // Only the read index is timed on a sample: it makes a system call per probe
+            size_t lookups = mapped ? kLookups : kLookups / 16;
+            size_t misses = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < lookups; ++i) {
+                std::streamoff offset = -1;
+                uint32_t length = 0;
+                bool found = index.find(entries[targets[i]].key, offset, length);
+                misses += !found || entries[static_cast<size_t>(offset / 40)].key != entries[targets[i]].key;
+            }
+            double seconds = secondsSince(start);
+            std::cout << "  " << std::setw(10) << kLayoutNames[layout] << (mapped ? " mapped " : " read   ") << std::fixed
+                      << std::setprecision(2) << std::setw(6) << static_cast<double>(lookups) / seconds / 1e6 << " M lookups/s "
+                      << std::setprecision(0) << std::setw(6) << seconds / static_cast<double>(lookups) * 1e9 << " ns/lookup"
+                      << (misses == 0 ? "" : "  MISMATCH") << std::endl;
+        }
+    }
+    std::remove(filename.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> names(argv + 1, argv + argc);
+    bool all = names.empty();
+    auto selected = [&](const char* name) {
+        return all || std::find(names.begin(), names.end(), name) != names.end();
+    };
+
+    if (selected("newline")) {
+        benchNewline();
+    }
+    if (selected("sort")) {
+        benchSort();
+    }
+    if (selected("lookup")) {
+        benchLookup();
+    }
+    if (selected("filter")) {
+        benchFilter();
+    }
+    if (selected("cover")) {
+        benchCover();
+    }
+    if (selected("mapped")) {
+        benchMapped();
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * Blocked Bloom filter of the keys of an index, for answering lookups of absent keys without searching the index.
+ *
+ * The filter is an array of 64-byte blocks, one cache line each. A key hashes to one block and sets `hashes` bits
+ * in it, so checking a key reads a single block wherever the filter is stored. Keeping the bits of a key together
+ * costs a slightly higher false positive rate than a classic Bloom filter of the same size, which filterBitsPerKey
+ * makes up for with a few more bits per key.
+*/
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "format.h"
+
+// Size of a block of the filter, one cache line.
+const size_t kFilterBlockSize = 64;
+// Most bits set per key.
+const uint32_t kMaxFilterHashes = 16;
+
+/**
+ * Final mixing step of MurmurHash3: every input bit affects every output bit.
+ *
+ * @param value The value to mix.
+ * @return uint64_t The mixed value.
+ */
+inline uint64_t mixBits(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+/**
+ * Hash a key for the filter, 8 bytes at a time. The bytes are read in little-endian order, so the hash, and the
+ * filter stored in an index file, are the same on every machine.
+ *
+ * @param key The key.
+ * @param length The length of the key.
+ * @return uint64_t The hash.
+ */
+inline uint64_t hashKey(const char* key, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        hash = mixBits(hash ^ loadLittleEndian(key + i, 8));
+    }
+    if (i < length) {
+        hash = mixBits(hash ^ loadLittleEndian(key + i, length - i));
+    }
+    return mixBits(hash);
+}
+
+/**
+ * Block of the filter a key belongs to: the high bits of the hash scaled to the number of blocks.
+ *
+ * @param hash The hash of the key.
+ * @param blockCount The number of blocks of the filter.
+ * @return uint64_t The block number.
+ */
+inline uint64_t filterBlock(uint64_t hash, uint64_t blockCount) {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(hash) * blockCount) >> 64);
+}
+
+/**
+ * Bits of a key within its block. The hash is remixed to draw 9-bit bit numbers, seven from each remix, so they
+ * do not depend on the bits that chose the block.
+ *
+ * @param hash The hash of the key.
+ * @param hashes The number of bits per key.
+ * @param bits Receives the bit numbers, below kFilterBlockSize * 8.
+ */
+inline void filterBits(uint64_t hash, uint32_t hashes, uint32_t bits[kMaxFilterHashes]) {
+    uint64_t draw = 0;
+    for (uint32_t i = 0; i < hashes; ++i) {
+        if (i % 7 == 0) {
+            draw = mixBits(hash + i + 1);
+        }
+        bits[i] = static_cast<uint32_t>(draw & (kFilterBlockSize * 8 - 1));
+        draw >>= 9;
+    }
+}
+
+/**
+ * Add a key to its block.
+ *
+ * @param block The block of the key (see filterBlock).
+ * @param hash The hash of the key.
+ * @param hashes The number of bits per key.
+ */
+inline void addToFilterBlock(char* block, uint64_t hash, uint32_t hashes) {
+    uint32_t bits[kMaxFilterHashes];
+    filterBits(hash, hashes, bits);
+    for (uint32_t i = 0; i < hashes; ++i) {
+        block[bits[i] / 8] = static_cast<char>(block[bits[i] / 8] | (1 << (bits[i] % 8)));
+    }
+}
+
+/**
+ * Check whether a key may have been added to its block.
+ *
+ * @param block The block of the key (see filterBlock).
+ * @param hash The hash of the key.
+ * @param hashes The number of bits per key.
+ * @return bool False if the key was certainly not added, true otherwise.
+ */
+inline bool filterBlockContains(const char* block, uint64_t hash, uint32_t hashes) {
+    uint32_t bits[kMaxFilterHashes];
+    filterBits(hash, hashes, bits);
+    for (uint32_t i = 0; i < hashes; ++i) {
+        if ((block[bits[i] / 8] & (1 << (bits[i] % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Size of a filter per key for a false positive rate.
+ * A classic Bloom filter needs log2(1 / rate) / ln 2 bits per key; blocking adds about a tenth.
+ *
+ * @param falsePositiveRate The wanted rate of absent keys the filter lets through, between 0 and 1.
+ * @return uint32_t The number of bits per key.
+ */
+inline uint32_t filterBitsPerKey(double falsePositiveRate) {
+    double bits = std::log2(1 / falsePositiveRate) / std::log(2.0) * 1.1;
+    return static_cast<uint32_t>(std::max(1.0, std::min(64.0, std::ceil(bits))));
+}
+
+/**
+ * Number of bits set per key that gives the lowest false positive rate for a filter size, capped at
+ * kMaxFilterHashes.
+ *
+ * @param bitsPerKey The size of the filter per key.
+ * @return uint32_t The number of bits set per key.
+ */
+inline uint32_t filterHashCount(uint32_t bitsPerKey) {
+    return static_cast<uint32_t>(std::max(1.0, std::min<double>(kMaxFilterHashes, std::round(bitsPerKey * std::log(2.0)))));
+}
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ * Reading and writing of the index file header.
+ * See format.h for the layout.
+*/
+#include "format.h"
+
+#include "filter.h"
+#include "mphf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace {
+
+// Magic number at the start of every index file.
+const char kIndexMagic[8] = { 'S', 'I', 'D', 'X', 'F', 'I', 'L', 'E' };
+// Bytes hashed at each end of the indexed part of the data file.
+const uint64_t kStampHashLength = 64 * 1024;
+
+/**
+ * FNV-1a hash of a block of bytes, continuing from an earlier hash value.
+ */
+uint64_t hashBytes(uint64_t hash, const char* bytes, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Hash the length and the first and last kStampHashLength bytes of the first `size` bytes of a file.
+ * Appending to the file does not change the hash of a prefix, so it identifies the indexed part of the data.
+ */
+bool hashDataPrefix(std::ifstream& file, uint64_t size, uint64_t& hash) {
+    char length[8];
+    storeLittleEndian(length, size, sizeof(length));
+    hash = hashBytes(14695981039346656037ULL, length, sizeof(length));
+
+    std::vector<char> block(static_cast<size_t>(std::min(size, kStampHashLength)));
+    const uint64_t starts[2] = { 0, size - block.size() };
+    for (uint64_t start : starts) {
+        file.seekg(static_cast<std::streamoff>(start));
+        if (!file.read(block.data(), static_cast<std::streamsize>(block.size()))) {
+            return false;
+        }
+        hash = hashBytes(hash, block.data(), block.size());
+    }
+    return true;
+}
+
+/**
+ * Look up the size and modification time of a file in nanoseconds since the epoch.
+ */
+bool statDataFile(const std::string& dataFilename, uint64_t& size, int64_t& modificationTime) {
+    struct stat status;
+    if (stat(dataFilename.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return false;
+    }
+    size = static_cast<uint64_t>(status.st_size);
+    modificationTime = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+    return true;
+}
+
+} // namespace
+
+IndexHeader makeIndexHeader(size_t keyLength, IndexLayout layout) {
+    IndexHeader header;
+    header.version = kIndexFormatVersion;
+    header.keyLength = static_cast<uint32_t>(keyLength);
+    header.offsetWidth = kMaxOffsetWidth;
+    header.lengthWidth = kRecordLengthSize;
+    header.entryCount = 0;
+    header.entriesOffset = kIndexHeaderSize;
+    header.flags = 0;
+    header.layout = layout;
+    header.data.size = 0;
+    header.data.modificationTime = 0;
+    header.data.hash = 0;
+    header.pageSize = 0;
+    header.restartInterval = 0;
+    header.fenceOffset = 0;
+    header.pageCount = 0;
+    header.rootNode = kNoNode;
+    header.treeHeight = 0;
+    header.modelError = 0;
+    header.keyColumns = 0;
+    header.filterOffset = 0;
+    header.filterBlocks = 0;
+    header.filterHashes = 0;
+    header.filterBitsPerKey = 0;
+    header.overflowWidth = 0;
+    std::memset(&header.projection, 0, sizeof(header.projection));
+    header.projection.kind = kNoProjection;
+    return header;
+}
+
+uint32_t offsetWidthFor(std::streamoff dataSize) {
+    if (dataSize < 0) {
+        return kMaxOffsetWidth;
+    }
+    // Offsets are below the size of the file
+    const uint32_t widths[3] = { 4, 5, 6 };
+    for (uint32_t width : widths) {
+        if (static_cast<uint64_t>(dataSize) <= static_cast<uint64_t>(1) << (8 * width)) {
+            return width;
+        }
+    }
+    return kMaxOffsetWidth;
+}
+
+uint32_t lengthWidthFor(uint32_t maxRecordLength) {
+    uint32_t width = 1;
+    while (width < kRecordLengthSize && maxRecordLength >> (8 * width) != 0) {
+        ++width;
+    }
+    return width;
+}
+
+void alignIndexEntries(IndexHeader& header) {
+    header.flags |= kAlignedEntries;
+    header.offsetWidth = kMaxOffsetWidth;
+    header.lengthWidth = kRecordLengthSize;
+}
+
+bool writeIndexHeader(std::ostream& out, const IndexHeader& header) {
+    std::vector<char> bytes(kIndexHeaderSize, 0);
+    std::memcpy(bytes.data(), kIndexMagic, sizeof(kIndexMagic));
+    storeLittleEndian(&bytes[8], header.version, 4);
+    storeLittleEndian(&bytes[12], kIndexHeaderSize, 4);
+    storeLittleEndian(&bytes[16], header.keyLength, 4);
+    storeLittleEndian(&bytes[20], header.offsetWidth, 4);
+    storeLittleEndian(&bytes[24], header.entryCount, 8);
+    storeLittleEndian(&bytes[32], header.entriesOffset, 8);
+    storeLittleEndian(&bytes[40], header.flags, 4);
+    storeLittleEndian(&bytes[44], header.layout, 4);
+    storeLittleEndian(&bytes[48], header.data.size, 8);
+    storeLittleEndian(&bytes[56], static_cast<uint64_t>(header.data.modificationTime), 8);
+    storeLittleEndian(&bytes[64], header.data.hash, 8);
+    storeLittleEndian(&bytes[72], header.pageSize, 4);
+    storeLittleEndian(&bytes[76], header.restartInterval, 4);
+    storeLittleEndian(&bytes[80], header.fenceOffset, 8);
+    storeLittleEndian(&bytes[88], header.pageCount, 8);
+    storeLittleEndian(&bytes[96], header.rootNode, 8);
+    storeLittleEndian(&bytes[104], header.treeHeight, 4);
+    storeLittleEndian(&bytes[108], header.lengthWidth, 4);
+    storeLittleEndian(&bytes[112], header.modelError, 4);
+    storeLittleEndian(&bytes[116], header.keyColumns, 4);
+    storeLittleEndian(&bytes[120], header.filterOffset, 8);
+    storeLittleEndian(&bytes[128], header.filterBlocks, 8);
+    storeLittleEndian(&bytes[136], header.filterHashes, 4);
+    storeLittleEndian(&bytes[140], header.filterBitsPerKey, 4);
+    storeLittleEndian(&bytes[144], header.overflowWidth, 4);
+    storeLittleEndian(&bytes[148], header.projection.payloadWidth, 4);
+    storeLittleEndian(&bytes[152], header.projection.kind, 4);
+    storeLittleEndian(&bytes[156], static_cast<unsigned char>(header.projection.delimiter), 4);
+    storeLittleEndian(&bytes[160], header.projection.rangeCount, 4);
+    for (uint32_t i = 0; i < header.projection.rangeCount; ++i) {
+        storeLittleEndian(&bytes[164 + 8 * i], header.projection.ranges[i][0], 4);
+        storeLittleEndian(&bytes[168 + 8 * i], header.projection.ranges[i][1], 4);
+    }
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    return out.good();
+}
+
+bool decodeIndexHeader(const char* bytes, size_t length, IndexHeader& header) {
+    if (length < kIndexHeaderSize || std::memcmp(bytes, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+        std::cerr << "Error: not an index file, or an index from an older version. Recreate it with -c." << std::endl;
+        return false;
+    }
+
+    header.version = static_cast<uint32_t>(loadLittleEndian(&bytes[8], 4));
+    if (header.version == 0 || header.version > kIndexFormatVersion) {
+        std::cerr << "Error: unsupported index format version " << header.version << ". Recreate the index with -c." << std::endl;
+        return false;
+    }
+    header.keyLength = static_cast<uint32_t>(loadLittleEndian(&bytes[16], 4));
+    header.offsetWidth = static_cast<uint32_t>(loadLittleEndian(&bytes[20], 4));
+    header.entryCount = loadLittleEndian(&bytes[24], 8);
+    header.entriesOffset = loadLittleEndian(&bytes[32], 8);
+    header.flags = static_cast<uint32_t>(loadLittleEndian(&bytes[40], 4));
+    uint32_t layout = static_cast<uint32_t>(loadLittleEndian(&bytes[44], 4));
+    header.layout = static_cast<IndexLayout>(layout);
+    header.data.size = loadLittleEndian(&bytes[48], 8);
+    header.data.modificationTime = static_cast<int64_t>(loadLittleEndian(&bytes[56], 8));
+    header.data.hash = loadLittleEndian(&bytes[64], 8);
+    header.pageSize = static_cast<uint32_t>(loadLittleEndian(&bytes[72], 4));
+    header.restartInterval = static_cast<uint32_t>(loadLittleEndian(&bytes[76], 4));
+    header.fenceOffset = loadLittleEndian(&bytes[80], 8);
+    header.pageCount = loadLittleEndian(&bytes[88], 8);
+    header.rootNode = loadLittleEndian(&bytes[96], 8);
+    header.treeHeight = static_cast<uint32_t>(loadLittleEndian(&bytes[104], 4));
+    header.lengthWidth = static_cast<uint32_t>(loadLittleEndian(&bytes[108], 4));
+    header.modelError = static_cast<uint32_t>(loadLittleEndian(&bytes[112], 4));
+    header.keyColumns = static_cast<uint32_t>(loadLittleEndian(&bytes[116], 4));
+    header.filterOffset = loadLittleEndian(&bytes[120], 8);
+    header.filterBlocks = loadLittleEndian(&bytes[128], 8);
+    header.filterHashes = static_cast<uint32_t>(loadLittleEndian(&bytes[136], 4));
+    header.filterBitsPerKey = static_cast<uint32_t>(loadLittleEndian(&bytes[140], 4));
+    header.overflowWidth = static_cast<uint32_t>(loadLittleEndian(&bytes[144], 4));
+    Projection& projection = header.projection;
+    std::memset(&projection, 0, sizeof(projection));
+    projection.payloadWidth = static_cast<uint32_t>(loadLittleEndian(&bytes[148], 4));
+    uint32_t kind = static_cast<uint32_t>(loadLittleEndian(&bytes[152], 4));
+    projection.kind = static_cast<ProjectionKind>(kind);
+    projection.delimiter = static_cast<char>(loadLittleEndian(&bytes[156], 4));
+    projection.rangeCount = static_cast<uint32_t>(loadLittleEndian(&bytes[160], 4));
+    bool validProjection = kind <= kFieldProjection && (kind == kNoProjection) == (projection.payloadWidth == 0) &&
+        projection.payloadWidth <= kMaxPayloadWidth && projection.rangeCount <= kMaxProjectionRanges;
+    for (uint32_t i = 0; validProjection && i < projection.rangeCount; ++i) {
+        projection.ranges[i][0] = static_cast<uint32_t>(loadLittleEndian(&bytes[164 + 8 * i], 4));
+        projection.ranges[i][1] = static_cast<uint32_t>(loadLittleEndian(&bytes[168 + 8 * i], 4));
+        validProjection = projection.ranges[i][0] > 0 && projection.ranges[i][0] <= projection.ranges[i][1];
+    }
+
+    size_t stride = storedEntryStride(header);
+    bool validLayout = layout == kFlatLayout || (layout == kPagedLayout && header.pageSize >= stride) ||
+        (layout == kBTreeLayout && header.pageSize >= kNodeHeaderSize + 2 * (stride + sizeof(uint64_t))) ||
+        (layout == kFrontCodedLayout && header.restartInterval > 0) || layout == kEytzingerLayout ||
+        (layout == kLearnedLayout && header.keyColumns <= header.keyLength) || (layout == kColumnarLayout && header.keyLength > 0) ||
+        (layout == kHashLayout && header.pageCount <= kMaxHashLevels) ||
+        (layout == kTableLayout && header.pageCount > 0 && (header.pageCount & (header.pageCount - 1)) == 0 && header.overflowWidth <= 8);
+    bool validWidths = header.offsetWidth > 0 && header.offsetWidth <= kMaxOffsetWidth &&
+        (!(header.flags & kAlignedEntries) || (header.offsetWidth == kMaxOffsetWidth && header.lengthWidth == kRecordLengthSize)) &&
+        header.lengthWidth <= kRecordLengthSize && (header.filterBlocks == 0 || (header.filterHashes > 0 && header.filterHashes <= kMaxFilterHashes));
+    if (!validWidths || !validProjection || header.entriesOffset < loadLittleEndian(&bytes[12], 4) || !validLayout) {
+        std::cerr << "Error: corrupt index header. Recreate the index with -c." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool checkIndexHeader(const IndexHeader& header, const std::string& dataFilename, size_t keyLength, bool warnAppended) {
+    if (header.keyLength != keyLength) {
+        std::cerr << "Error: the index was built with key length " << header.keyLength << ", not " << keyLength << "." << std::endl;
+        return false;
+    }
+
+    if (header.flags & kHasDataStamp) {
+        DataFileState state = checkDataFile(dataFilename, header.data);
+        if (state == kDataFileChanged) {
+            std::cerr << "Error: the data file has changed since the index was built. Recreate the index with -c." << std::endl;
+            return false;
+        }
+        if (state == kDataFileAppended && warnAppended) {
+            std::cerr << "Warning: records were appended to the data file since the index was built. "
+                      << "Run -u to index them." << std::endl;
+        }
+    }
+    return true;
+}
+
+bool stampDataFile(const std::string& dataFilename, uint64_t size, DataStamp& stamp) {
+    uint64_t currentSize;
+    if (!statDataFile(dataFilename, currentSize, stamp.modificationTime) || size > currentSize) {
+        return false;
+    }
+    std::ifstream file(dataFilename, std::ifstream::binary);
+    stamp.size = size;
+    return file && hashDataPrefix(file, size, stamp.hash);
+}
+
+DataFileState checkDataFile(const std::string& dataFilename, const DataStamp& stamp) {
+    uint64_t size;
+    int64_t modificationTime;
+    if (!statDataFile(dataFilename, size, modificationTime) || size < stamp.size) {
+        return kDataFileChanged;
+    }
+    if (size == stamp.size && modificationTime == stamp.modificationTime) {
+        return kDataFileCurrent;
+    }
+
+    // The file was written to: it is unchanged or appended to if the indexed part still hashes the same
+    std::ifstream file(dataFilename, std::ifstream::binary);
+    uint64_t hash;
+    if (!file || !hashDataPrefix(file, stamp.size, hash) || hash != stamp.hash) {
+        return kDataFileChanged;
+    }
+    return size == stamp.size ? kDataFileCurrent : kDataFileAppended;
+}
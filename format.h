@@ -0,0 +1,599 @@
+/**
+ * On-disk format of the index file.
+ *
+ * The index file starts with a header padded to one page (4096 bytes), followed by the sorted entries.
+ * All header fields are little-endian:
+ *
+ *   offset  size  field
+ *        0     8  magic "SIDXFILE"
+ *        8     4  format version
+ *       12     4  header size in bytes
+ *       16     4  key length
+ *       20     4  width of the record offsets of the entries in bytes
+ *       24     8  number of entries
+ *       32     8  file offset of the first entry
+ *       40     4  flags (kHasDataStamp, kAlignedEntries)
+ *       44     4  layout of the entries (IndexLayout)
+ *       48     8  size of the data file when it was indexed
+ *       56     8  modification time of the data file in nanoseconds since the epoch
+ *       64     8  hash of the first and last 64 KiB of the indexed data
+ *       72     4  page size of the paged layout, node size of the B+tree layout
+ *       76     4  restart interval of the front-coded layout
+ *       80     8  file offset of the fence array of the paged layout, of the block index of the front-coded layout,
+ *                 of the model of the learned layout, of the hash function of the hash layout, of the table of the
+ *                 table layout, of the value column of the columnar layout
+ *       88     8  number of pages of the paged layout, number of leaves of the B+tree layout, number of blocks of
+ *                 the front-coded layout, number of segments of the learned layout, number of levels of the hash
+ *                 function of the hash layout, number of slots of the table layout
+ *       96     8  node number of the root of the B+tree layout (kNoNode if the index is empty)
+ *      104     4  number of levels of the B+tree layout, leaves included
+ *      108     4  width of the record lengths of the entries in bytes (0 in version 1 files, which store none)
+ *      112     4  maximum error of the model of the learned layout, in entries
+ *      116     4  number of leading key bytes the model of the learned layout maps to numbers
+ *      120     8  file offset of the key filter (0 if the index has none)
+ *      128     8  number of 64-byte blocks of the key filter
+ *      136     4  number of bits the key filter sets per key
+ *      140     4  size of the key filter in bits per entry, kept when the index is updated
+ *      144     4  width of the overflow fields of the slots of the table layout in bytes
+ *      148     4  width of the payload of the entries in bytes, 0 if they have none
+ *      152     4  kind of the projection of the records stored in the payloads (ProjectionKind)
+ *      156     4  field delimiter of the projection
+ *      160     4  number of ranges of the projection
+ *      164   128  first and last byte or field of every range of the projection, 4 bytes each
+ *
+ * The data file stamp lets readers check an index against its data file without scanning the data.
+ *
+ * Every entry is stored as the key, the offset of the record in the data file in offsetWidth little-endian bytes,
+ * and the length of the record without its newline in lengthWidth little-endian bytes. The widths are the
+ * smallest that hold every value of the index (see offsetWidthFor and lengthWidthFor), so the entries of a data
+ * file under 4 GiB with records under 64 KiB take 6 bytes after the key. A stored length of all ones in a
+ * 4-byte field stands for a record whose length is not known, which is then read up to its newline.
+ *
+ * Indexes with the kAlignedEntries flag trade that space for entries that can be used where they are mapped: the
+ * key is followed by zero bytes up to a multiple of 8, the offset takes 8 bytes and the length 4, and 4 more zero
+ * bytes end the entry, so the offset of every entry is 8-byte aligned in the file and is loaded with a single
+ * load on little-endian machines. The sizes of the fields never depend on the machine that wrote the index.
+ *
+ * Covering indexes end every entry with a payload of payloadWidth + 1 bytes holding the projection of its record
+ * (see projection.h): the length of the projection in one byte, then the projection padded with zeros. Projections
+ * longer than payloadWidth are stored as the length kPayloadOverflow followed by zeros. The payload comes before the
+ * padding of aligned entries.
+ *
+ * In the flat layout the entries follow each other. In the paged layout the entries are grouped into pages of
+ * pageSize bytes, each holding as many whole entries as fit and zero padding; the last page may hold fewer.
+ * The fence array after the pages holds a copy of the first entry of every page, so a reader that keeps it in
+ * memory finds the page holding a key without touching the pages.
+ *
+ * In the B+tree layout the file after the header is an array of nodes of pageSize bytes, numbered from zero.
+ * Every node starts with a kNodeHeaderSize-byte header: the level (0 for leaves), the number of items, and for
+ * leaves the number of the next leaf in key order (kNoNode for the last leaf). Leaf items are entries. Items of
+ * inner nodes are the first entry of a child followed by the 8-byte child node number. The tree is built bottom-up:
+ * the leaves come first, in order, then each level above them, and the root last.
+ *
+ * In the front-coded layout every entry is stored as the number of leading key bytes it shares with the key of
+ * the entry before it (an unsigned LEB128 varint), the remaining key bytes, the offset and the length. The entries are cut
+ * into blocks of restartInterval entries, and the first entry of every block shares nothing, so a block can be
+ * decoded on its own. The block index after the blocks holds, for every block, its first entry followed by the
+ * 8-byte file offset of the block.
+ *
+ * In the Eytzinger layout the entries are stored in the breadth-first order of an implicit balanced binary search
+ * tree: the entry at position k (counting from 1) has its children at positions 2k and 2k + 1, so a search
+ * descends with position arithmetic alone. The entry of rank r in key order is at the r-th position of an in-order
+ * walk of the tree (see firstEytzingerPosition and nextEytzingerPosition).
+ *
+ * In the learned layout the entries follow each other as in the flat layout, and the model after them predicts the
+ * position of a key. Keys are mapped to numbers by learnedKeyValue, which reads the first keyColumns key bytes as
+ * the digits of a mixed-radix number, each digit ranging over the byte values seen at its position. The model is
+ * a list of segments, each the smallest mapped key it covers, the position of the first entry with that key, and a
+ * slope, all 8 bytes (the slope an IEEE double): the first entry not less than a key mapped into a segment is within
+ * modelError entries of the line through the segment, unless the key falls among entries with equal mapped keys.
+ * The model starts with the smallest and largest byte of every mapped key position, two bytes per position,
+ * followed by the segments in key order.
+ *
+ * In the hash layout every key has one entry, as an index with a key on several records is not built in it, and the
+ * entries are not sorted: the entry of a key is at the position the minimal perfect hash function after the entries gives the key (see mphf.h). The entries of
+ * keys the function leaves without a position come last, in key order.
+ *
+ * In the table layout the first entry of every key is stored in an open-addressing hash table after the other
+ * entries, which form the overflow area: the further entries of every key, in offset order, one key after another
+ * in key order (see table.h).
+ *
+ * In the columnar layout the entries are split into two arrays in key order. The key column holds the keys in
+ * blocks of kKeyBlockSize bytes, one cache line, each holding as many whole keys as fit and zero padding (keys
+ * longer than half a block are stored back to back instead, one per block). The value column after it, at
+ * fenceOffset, holds the rest of every entry: the offset, the length and any payload, in storedValueStride bytes.
+ *
+ * Any layout but the hash layout may be followed by a blocked Bloom filter of the keys (see filter.h), aligned to
+ * 64 bytes, which lets lookups of absent keys stop after reading one block of the filter.
+*/
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "index.h"
+
+// Version of the index file format written by this program. Version 1 files, with 8-byte offsets and no record
+// lengths, are still read.
+const uint32_t kIndexFormatVersion = 2;
+// Size of the header at the start of the index file.
+const size_t kIndexHeaderSize = 4096;
+// Header flag: the data size, modification time and hash were recorded.
+const uint32_t kHasDataStamp = 1;
+// Header flag: the entries are padded so their offsets are 8-byte aligned (see alignIndexEntries).
+const uint32_t kAlignedEntries = 2;
+// Width of the widest stored record offset.
+const uint32_t kMaxOffsetWidth = 8;
+// Widest payload of a covering index.
+const uint32_t kMaxPayloadWidth = 254;
+// Stored payload length of a projection that does not fit in the payload.
+const uint32_t kPayloadOverflow = 255;
+// Size of the pages of the paged layout, one page of the operating system.
+const size_t kIndexPageSize = 4096;
+// Size of the header at the start of every B+tree node.
+const size_t kNodeHeaderSize = 16;
+// Node number standing for no node.
+const uint64_t kNoNode = UINT64_MAX;
+// Number of entries in a block of the front-coded layout.
+const uint32_t kRestartInterval = 16;
+// Maximum distance in entries between the position the model of the learned layout predicts and the actual one.
+const uint32_t kModelError = 64;
+// Size of a segment of the model of the learned layout.
+const size_t kSegmentSize = 24;
+// Size of the blocks of the key column of the columnar layout, one cache line.
+const size_t kKeyBlockSize = 64;
+
+/**
+ * Identification of the data file contents an index was built from.
+*/
+struct DataStamp {
+    uint64_t size;
+    int64_t modificationTime;
+    uint64_t hash;
+};
+
+/**
+ * Fields of the index file header.
+*/
+struct IndexHeader {
+    uint32_t version;
+    uint32_t keyLength;
+    uint32_t offsetWidth;
+    uint32_t lengthWidth;
+    uint64_t entryCount;
+    uint64_t entriesOffset;
+    uint32_t flags;
+    IndexLayout layout;
+    DataStamp data;
+    uint32_t pageSize;
+    uint32_t restartInterval;
+    uint64_t fenceOffset;
+    uint64_t pageCount;
+    uint64_t rootNode;
+    uint32_t treeHeight;
+    uint32_t modelError;
+    uint32_t keyColumns;
+    uint64_t filterOffset;
+    uint64_t filterBlocks;
+    uint32_t filterHashes;
+    uint32_t filterBitsPerKey;
+    uint32_t overflowWidth;
+    Projection projection;
+};
+
+/**
+ * Result of checking an index against its data file.
+*/
+enum DataFileState {
+    kDataFileCurrent,   // The data file is the one that was indexed
+    kDataFileAppended,  // Records were appended to the data file after it was indexed
+    kDataFileChanged    // The indexed part of the data file was changed, or it cannot be checked
+};
+
+/**
+ * Create a header for an index written by this program.
+ *
+ * @param keyLength The length of the keys in the index file.
+ * @param layout The arrangement of the entries.
+ * @return IndexHeader The header, with no entries, no data stamp, and the widest offsets and record lengths.
+ */
+IndexHeader makeIndexHeader(size_t keyLength, IndexLayout layout);
+
+/**
+ * Smallest stored offset width for a data file: 4, 5, 6 or 8 bytes.
+ *
+ * @param dataSize The size of the data file, negative if it is not known.
+ * @return uint32_t The number of bytes needed to store any offset in the file.
+ */
+uint32_t offsetWidthFor(std::streamoff dataSize);
+
+/**
+ * Smallest stored record length width: 1 to 4 bytes.
+ *
+ * @param maxRecordLength The largest record length of the index, or kUnknownRecordLength.
+ * @return uint32_t The number of bytes needed to store any record length of the index.
+ */
+uint32_t lengthWidthFor(uint32_t maxRecordLength);
+
+/**
+ * Switch a header to aligned entries: 8-byte offsets and 4-byte record lengths, with the padding that aligns the
+ * offset of every entry to 8 bytes.
+ *
+ * @param header The header.
+ */
+void alignIndexEntries(IndexHeader& header);
+
+/**
+ * Write a header at the current position of the stream, padded to kIndexHeaderSize bytes.
+ *
+ * @param out The stream receiving the header.
+ * @param header The header to write.
+ * @return bool False if the stream failed, true otherwise.
+ */
+bool writeIndexHeader(std::ostream& out, const IndexHeader& header);
+
+/**
+ * Decode and validate the header at the start of an index file.
+ * Prints an error if the file is not an index file or uses an unsupported format version.
+ *
+ * @param bytes The first bytes of the index file.
+ * @param length The number of bytes available, which may be less than kIndexHeaderSize for short files.
+ * @param header Receives the header fields.
+ * @return bool True if the header is valid, false otherwise.
+ */
+bool decodeIndexHeader(const char* bytes, size_t length, IndexHeader& header);
+
+/**
+ * Check that an index matches the expected key length and the data file.
+ * Prints an error if the index cannot be used, and a warning if records were appended to the data file after the
+ * index was built (the index is still usable for the records it covers).
+ *
+ * @param header The header of the index file.
+ * @param dataFilename The name of the data file.
+ * @param keyLength The key length given on the command line.
+ * @param warnAppended Whether to warn about appended records; false when they are about to be indexed.
+ * @return bool True if the index can be used, false otherwise.
+ */
+bool checkIndexHeader(const IndexHeader& header, const std::string& dataFilename, size_t keyLength, bool warnAppended = true);
+
+/**
+ * Record the size, modification time and content hash of the first `size` bytes of a data file.
+ *
+ * @param dataFilename The name of the data file.
+ * @param size The number of bytes of the data file that were indexed.
+ * @param stamp Receives the stamp.
+ * @return bool False if the data file could not be read, true otherwise.
+ */
+bool stampDataFile(const std::string& dataFilename, uint64_t size, DataStamp& stamp);
+
+/**
+ * Compare a data file with the stamp recorded when it was indexed.
+ * The size and modification time are checked first; the content hash is only computed when they differ.
+ *
+ * @param dataFilename The name of the data file.
+ * @param stamp The recorded stamp.
+ * @return DataFileState Whether the data file is unchanged, was appended to, or was changed.
+ */
+DataFileState checkDataFile(const std::string& dataFilename, const DataStamp& stamp);
+
+/**
+ * Store the low `width` bytes of a value in little-endian order.
+ *
+ * @param destination The buffer receiving the bytes.
+ * @param value The value to store.
+ * @param width The number of bytes to store, at most 8.
+ */
+inline void storeLittleEndian(char* destination, uint64_t value, size_t width) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (width == 8) {
+        std::memcpy(destination, &value, 8);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < width; ++i) {
+        destination[i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+/**
+ * Load a value stored in `width` little-endian bytes.
+ *
+ * @param source The bytes to load.
+ * @param width The number of bytes, at most 8.
+ * @return uint64_t The value.
+ */
+inline uint64_t loadLittleEndian(const char* source, size_t width) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // The stored bytes are the value as it is in memory
+    if (width == 8) {
+        uint64_t value;
+        std::memcpy(&value, source, 8);
+        return value;
+    }
+    if (width == 4) {
+        uint32_t value;
+        std::memcpy(&value, source, 4);
+        return value;
+    }
+#endif
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(source[i])) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * Load a stored record length.
+ *
+ * @param source The bytes to load.
+ * @param width The number of bytes, 0 if the index stores no record lengths.
+ * @return uint32_t The record length, kUnknownRecordLength if it is not known.
+ */
+inline uint32_t loadStoredLength(const char* source, size_t width) {
+    return width > 0 ? static_cast<uint32_t>(loadLittleEndian(source, width)) : kUnknownRecordLength;
+}
+
+/**
+ * Position of the record offset within an entry as stored in an index file, after the key and any padding.
+ *
+ * @param header The header of the index file.
+ * @return size_t The position in bytes from the start of the entry.
+ */
+inline size_t storedOffsetPosition(const IndexHeader& header) {
+    return header.flags & kAlignedEntries ? (header.keyLength + 7) / 8 * 8 : header.keyLength;
+}
+
+/**
+ * Position of the payload within an entry as stored in an index file, after the record length.
+ *
+ * @param header The header of the index file.
+ * @return size_t The position in bytes from the start of the entry.
+ */
+inline size_t storedPayloadPosition(const IndexHeader& header) {
+    return storedOffsetPosition(header) + header.offsetWidth + header.lengthWidth;
+}
+
+/**
+ * Size of an entry as stored in an index file.
+ *
+ * @param header The header of the index file.
+ * @return size_t The size of a stored entry in bytes.
+ */
+inline size_t storedEntryStride(const IndexHeader& header) {
+    const uint32_t payloadWidth = header.projection.payloadWidth;
+    size_t end = storedPayloadPosition(header) + (payloadWidth > 0 ? payloadWidth + 1 : 0);
+    return header.flags & kAlignedEntries ? (end + 7) / 8 * 8 : end;
+}
+
+/**
+ * Load the record offset of a stored entry.
+ *
+ * @param stored The entry in the index file.
+ * @param header The header of the index file.
+ * @return std::streamoff The offset of the record in the data file.
+ */
+inline std::streamoff loadStoredOffset(const char* stored, const IndexHeader& header) {
+    return static_cast<std::streamoff>(loadLittleEndian(stored + storedOffsetPosition(header), header.offsetWidth));
+}
+
+/**
+ * Load the record length of a stored entry.
+ *
+ * @param stored The entry in the index file.
+ * @param header The header of the index file.
+ * @return uint32_t The length of the record without its newline, kUnknownRecordLength if it is not known.
+ */
+inline uint32_t loadStoredRecordLength(const char* stored, const IndexHeader& header) {
+    return loadStoredLength(stored + storedOffsetPosition(header) + header.offsetWidth, header.lengthWidth);
+}
+
+/**
+ * Size of the part of a stored entry after the key and its padding: the record offset, the record length and any
+ * payload, as stored in the value column of the columnar layout.
+ *
+ * @param header The header of the index file.
+ * @return size_t The size in bytes.
+ */
+inline size_t storedValueStride(const IndexHeader& header) {
+    return storedEntryStride(header) - storedOffsetPosition(header);
+}
+
+/**
+ * Number of keys in a block of the key column of the columnar layout.
+ *
+ * @param keyLength The length of the keys.
+ * @return size_t The number of keys, at least 2 for keys up to half a block long, 1 for longer keys.
+ */
+inline size_t columnKeysPerBlock(size_t keyLength) {
+    return keyLength <= kKeyBlockSize / 2 ? kKeyBlockSize / keyLength : 1;
+}
+
+/**
+ * Size of a block of the key column of the columnar layout.
+ *
+ * @param keyLength The length of the keys.
+ * @return size_t The size in bytes: kKeyBlockSize, or the key length for keys longer than half a block.
+ */
+inline size_t columnBlockSize(size_t keyLength) {
+    return keyLength <= kKeyBlockSize / 2 ? kKeyBlockSize : keyLength;
+}
+
+/**
+ * Load the payload of a stored entry of a covering index.
+ *
+ * @param stored The entry in the index file.
+ * @param header The header of the index file, whose payloadWidth is not 0.
+ * @param payload Receives the projection of the record.
+ * @return bool False if the projection did not fit in the payload, true otherwise.
+ */
+inline bool loadStoredPayload(const char* stored, const IndexHeader& header, std::string& payload) {
+    const char* position = stored + storedPayloadPosition(header);
+    uint32_t length = static_cast<unsigned char>(position[0]);
+    if (length > header.projection.payloadWidth) {
+        return false;
+    }
+    payload.assign(position + 1, length);
+    return true;
+}
+
+/**
+ * Store the projection of a record in the payload of a stored entry of a covering index.
+ *
+ * @param projected The projection of the record (see projectRecord).
+ * @param stored The entry in the index file.
+ * @param header The header of the index file, whose payloadWidth is not 0.
+ */
+inline void encodePayload(const std::string& projected, char* stored, const IndexHeader& header) {
+    char* position = stored + storedPayloadPosition(header);
+    const uint32_t width = header.projection.payloadWidth;
+    size_t length = projected.size() <= width ? projected.size() : 0;
+    position[0] = static_cast<char>(projected.size() <= width ? projected.size() : kPayloadOverflow);
+    std::memcpy(position + 1, projected.data(), length);
+    std::memset(position + 1 + length, 0, width - length);
+}
+
+/**
+ * Convert an entry from its layout in memory (see entryStride) to its layout in the index file. The payload of a
+ * covering index is stored separately (see encodePayload).
+ *
+ * @param entry The entry in memory.
+ * @param stored Receives storedEntryStride(header) bytes.
+ * @param header The header of the index file.
+ */
+inline void encodeIndexEntry(const char* entry, char* stored, const IndexHeader& header) {
+    std::streamoff offset;
+    uint32_t length;
+    const size_t offsetPosition = storedOffsetPosition(header);
+    std::memcpy(stored, entry, header.keyLength);
+    std::memcpy(&offset, entry + header.keyLength, sizeof(offset));
+    std::memcpy(&length, entry + header.keyLength + sizeof(offset), sizeof(length));
+    if (header.flags & kAlignedEntries) {
+        std::memset(stored + header.keyLength, 0, storedEntryStride(header) - header.keyLength);
+    }
+    storeLittleEndian(stored + offsetPosition, static_cast<uint64_t>(offset), header.offsetWidth);
+    storeLittleEndian(stored + offsetPosition + header.offsetWidth, length, header.lengthWidth);
+}
+
+/**
+ * Convert an entry from its layout in the index file to its layout in memory.
+ *
+ * @param stored The entry in the index file.
+ * @param entry Receives entryStride(keyLength) bytes.
+ * @param header The header of the index file.
+ */
+inline void decodeIndexEntry(const char* stored, char* entry, const IndexHeader& header) {
+    std::streamoff offset = loadStoredOffset(stored, header);
+    uint32_t length = loadStoredRecordLength(stored, header);
+    std::memcpy(entry, stored, header.keyLength);
+    std::memcpy(entry + header.keyLength, &offset, sizeof(offset));
+    std::memcpy(entry + header.keyLength + sizeof(offset), &length, sizeof(length));
+}
+
+/**
+ * Position of the smallest entry in the Eytzinger layout: the leftmost node of the tree.
+ *
+ * @param count The number of entries.
+ * @return uint64_t The position, counting from 1, or 0 if there are no entries.
+ */
+inline uint64_t firstEytzingerPosition(uint64_t count) {
+    uint64_t position = count > 0 ? 1 : 0;
+    while (position > 0 && 2 * position <= count) {
+        position *= 2;
+    }
+    return position;
+}
+
+/**
+ * Position of the entry following the entry at a position in key order: the in-order successor in the tree.
+ * The positions of each level of the tree are visited in increasing order, so an in-order walk reads every level
+ * sequentially.
+ *
+ * @param position The current position, counting from 1.
+ * @param count The number of entries.
+ * @return uint64_t The next position, or 0 after the largest entry.
+ */
+inline uint64_t nextEytzingerPosition(uint64_t position, uint64_t count) {
+    if (2 * position + 1 <= count) {
+        // Leftmost node of the right subtree
+        position = 2 * position + 1;
+        while (2 * position <= count) {
+            position *= 2;
+        }
+        return position;
+    }
+    // Climb past the ancestors whose right subtree this is
+    return position >> __builtin_ffsll(static_cast<long long>(~position));
+}
+
+/**
+ * Map a key to a number for the model of the learned layout, preserving the order of keys.
+ * Key byte i is a digit from 0 to columns[2i + 1] - columns[2i], the range of the bytes the indexed keys hold at that
+ * position. The digits of a key outside the ranges saturate: after a byte below its range every later digit is
+ * 0, and after a byte above its range every later digit is the largest.
+ *
+ * @param key The key.
+ * @param columns The smallest and largest byte of every mapped key position.
+ * @param columnCount The number of mapped key positions, whose digit ranges multiply to less than 2^64.
+ * @return uint64_t The mapped key.
+ */
+inline uint64_t learnedKeyValue(const char* key, const unsigned char* columns, size_t columnCount) {
+    uint64_t value = 0;
+    int saturation = 0;  // -1 below the ranges, 1 above them
+    for (size_t i = 0; i < columnCount; ++i) {
+        unsigned low = columns[2 * i];
+        unsigned high = columns[2 * i + 1];
+        unsigned byte = static_cast<unsigned char>(key[i]);
+        if (saturation == 0 && (byte < low || byte > high)) {
+            saturation = byte < low ? -1 : 1;
+        }
+        unsigned digit = saturation < 0 ? 0 : saturation > 0 ? high - low : byte - low;
+        value = value * (high - low + 1) + digit;
+    }
+    return value;
+}
+
+/**
+ * Store a value as an unsigned LEB128 varint: 7 bits per byte, least significant first, with the high bit set on
+ * every byte but the last.
+ *
+ * @param destination The buffer receiving the bytes, with room for at least 10 bytes.
+ * @param value The value to store.
+ * @return size_t The number of bytes stored.
+ */
+inline size_t storeVarint(char* destination, uint64_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        destination[length++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    destination[length++] = static_cast<char>(value);
+    return length;
+}
+
+/**
+ * Load an unsigned LEB128 varint.
+ *
+ * @param source The bytes to load.
+ * @param end The end of the bytes that may be loaded.
+ * @param value Receives the value.
+ * @return size_t The number of bytes loaded, or 0 if the varint runs past the end or is longer than 64 bits allow.
+ */
+inline size_t loadVarint(const char* source, const char* end, uint64_t& value) {
+    value = 0;
+    size_t length = 0;
+    for (unsigned shift = 0; shift < 64 && source + length < end; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(source[length++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return length;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * Declarations shared by the modules of the indexer program.
+ *
+ * The index file contains entries with fixed-length keys, the offsets of the corresponding records in the data file and
+ * the lengths of those records. Entries are ordered by key, and entries with equal keys are ordered by offset, so that every way of building
+ * the index produces the same file.
+*/
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/**
+ * Structure to represent an entry in the index file.
+*/
+struct IndexEntry {
+    std::string key;
+    std::streamoff offset;
+};
+
+/**
+ * Arrangement of the sorted entries in the index file.
+*/
+enum IndexLayout {
+    kFlatLayout = 0,        // Entries back to back
+    kPagedLayout = 1,       // Entries in fixed-size pages, with the first entry of every page in a fence array
+    kBTreeLayout = 2,       // Entries in the leaves of a B+tree of fixed-size nodes
+    kFrontCodedLayout = 3,  // Entries with prefix-compressed keys, in blocks that restart the compression
+    kEytzingerLayout = 4,   // Entries in the breadth-first order of an implicit binary search tree
+    kLearnedLayout = 5,     // Entries back to back, with a piecewise linear model predicting the position of a key
+    kHashLayout = 6,        // Entries of distinct keys, at the positions a minimal perfect hash function gives them
+    kTableLayout = 7,       // First entry of every key in an open-addressing hash table, the others in an overflow area
+    kColumnarLayout = 8     // Keys in one array of cache-line blocks, record offsets and lengths in another
+};
+
+/**
+ * Check whether a layout stores the entries in key order, so they can be merged and listed in order.
+ *
+ * @param layout The layout.
+ * @return bool False for the layouts that store the entries in the order of a hash of their keys, true otherwise.
+ */
+inline bool isSortedLayout(IndexLayout layout) {
+    return layout != kHashLayout && layout != kTableLayout;
+}
+
+/**
+ * Kind of the part of every record an index stores in the record's entry.
+*/
+enum ProjectionKind {
+    kNoProjection = 0,     // Entries hold no part of their record
+    kByteProjection = 1,   // Byte ranges of the record
+    kFieldProjection = 2   // Fields of the record, separated by a delimiter
+};
+
+// Most ranges of a projection.
+const uint32_t kMaxProjectionRanges = 16;
+// Last position of a range reaching to the end of the record.
+const uint32_t kProjectionEnd = UINT32_MAX;
+
+/**
+ * Part of every record stored in its index entry, so queries needing only that part are answered from the index
+ * (see projection.h).
+*/
+struct Projection {
+    ProjectionKind kind;
+    // Separator of the fields of a field projection
+    char delimiter;
+    // Number of ranges in use
+    uint32_t rangeCount;
+    // First and last byte or field of every range, counting from 1, in increasing order and not overlapping
+    uint32_t ranges[kMaxProjectionRanges][2];
+    // Number of bytes of the projection stored in every entry, 0 without a projection
+    uint32_t payloadWidth;
+};
+
+/**
+ * Settings controlling how an index file is built.
+*/
+struct BuildOptions {
+    // Number of bytes the entries may occupy in memory while sorting; the table layout builds its table in memory
+    // beyond it
+    size_t memoryBudget;
+    // Number of threads scanning the data file
+    size_t threads;
+    // Arrangement of the entries in the index file
+    IndexLayout layout;
+    // Size of the pages of the paged layout and of the nodes of the B+tree layout
+    size_t pageSize;
+    // Rate of absent keys the key filter lets through to the index, 0 for no filter
+    double falsePositiveRate;
+    // Whether the entries are padded so their fields can be used in a mapping of the index (see alignIndexEntries)
+    bool alignedEntries;
+    // Part of every record stored in its entry
+    Projection projection;
+};
+
+// Largest number of threads an index may be built with
+const size_t kMaxThreads = 1024;
+
+// Size of the record length stored after the offset of an entry in memory
+const size_t kRecordLengthSize = sizeof(uint32_t);
+// Record length of records too long to store, and of entries whose record length is not known
+const uint32_t kUnknownRecordLength = UINT32_MAX;
+
+/**
+ * Size of an index entry while it is sorted: the key, the offset of the record as a std::streamoff and the length
+ * of the record as a uint32_t, all in host byte order. Entries are stored in the index file with narrower fields
+ * (see format.h).
+ *
+ * @param keyLength The length of the keys in the index file.
+ * @return size_t The size of an entry in bytes.
+ */
+inline size_t entryStride(size_t keyLength) {
+    return keyLength + sizeof(std::streamoff) + kRecordLengthSize;
+}
+
+/**
+ * Compare two IndexEntry objects based on their keys, then on their offsets.
+ *
+ * @param a The first IndexEntry object.
+ * @param b The second IndexEntry object.
+ * @return bool True if the first object sorts before the second object, false otherwise.
+ */
+bool compareIndexEntries(const IndexEntry& a, const IndexEntry& b);
+
+#endif
@@ -1,12 +1,56 @@
 /**
  * C++ program to create an index file for a data file and search for records using the index file.
- * The index file contains entries with fixed-length keys and 8-byte offsets to the corresponding records in the data file.
+ * The index file contains entries with fixed-length keys and the offsets and lengths of the corresponding records in
+ * the data file, so a record is read with a single read of its exact size.
  * The keys are extracted from the beginning of each record in the data file.
+ * A header at the start of the index file records the key length, the number of entries and the state of the data
+ * file when it was indexed (see format.h).
  * 
  * The program supports the following modes:
  * -c: Create an index file for the data file.
+ * -u: Update an index file with the records appended to the data file since it was built.
  * -l: List records from the data file using the index file.
- * -s: Search for a record by key in the index file.
+ * -s: Search for the records with a key in the index file.
+ * -S: Search for the records of many keys, read one per line from a file, or from standard input with -S -.
+ * -r: List the records whose keys are in a range, from a lower to an upper key, both included.
+ * -p: List the records whose keys start with a prefix.
+ *
+ * Options:
+ * --mem size: Memory budget for sorting index entries (e.g. 512M, 2G). Entries that do not fit are sorted in runs
+ *             on disk and merged. Defaults to half of the physical memory. The table layout builds its hash
+ *             table in memory whatever the budget.
+ * --threads n: Number of threads scanning the data file and sorting the entries when creating an index.
+ *              Defaults to the number of cores; at most 1024.
+ * --layout flat|paged|btree|front|eytzinger|learned|hash|table|columnar: Arrangement of the entries in a new index file.
+ *         The paged layout (the default) finds a key with at most one page read; the B+tree layout with one node
+ *         read per level below the root; the front-coded layout prefix-compresses the keys in blocks of 16 and reads
+ *         one block; the Eytzinger layout stores the entries in breadth-first tree order for searches in memory; the
+ *         learned layout predicts the position of a key with a piecewise linear model and reads the entries around
+ *         it; the hash layout stores the entry of every key at the position a minimal perfect hash function gives
+ *         it and reads that one entry; the table layout stores the keys in a hash table that is searched in a
+ *         mapping of the index; the columnar layout stores the keys in cache-line blocks apart from the offsets and
+ *         lengths, and compares the key with a whole block at once in a mapping of the index; the flat layout
+ *         stores the entries back to back. The hash and table layouts list the records unsorted. The hash layout
+ *         holds one record per key: -c and -u fail on a data file with a key on more than one record.
+ * --hash: Same as --layout table.
+ * --aligned: Store the offset of every entry in 8 bytes aligned to 8 in the index file, and its length in 4 bytes,
+ *            so searches of a mapped index read them in place. Takes more space than the default narrowest fields.
+ * --page-size size: Size of the pages of the paged layout and the nodes of the B+tree layout, a power of two
+ *                   from 4K to 64K. Defaults to 4K.
+ * --bloom rate: False positive rate of the Bloom filter stored with a new index, which answers searches for
+ *               absent keys with one small read. Defaults to 0.01; 0 builds no filter.
+ * --cover-bytes list: Store the given bytes of every record in its entry of a new index (a covering index), as
+ *                     ranges counting from 1 like those of cut, e.g. 1-40 or 5-12,30-.
+ * --cover-fields list: Store the given fields of every record in its entry of a new index, split at the delimiter
+ *                      and joined with it, e.g. 2,4-5.
+ * --delimiter c: Separator of the fields of --cover-fields. Defaults to a tab.
+ * --cover-width n: Bytes of the projection stored in every entry, up to 254. Defaults to the number of bytes of
+ *                  --cover-bytes ranges that end within the record, and to 32 otherwise. The projections of
+ *                  longer records are computed from the data file when they are queried.
+ * --covered: With -l, -s and -S, print the projection of the records stored in a covering index instead of the
+ *            records, without reading the data file.
+ * --key-order: With -S, print the results in key order rather than in the order of the keys read.
+ * --limit n: With -r and -p, list at most n records.
  * 
  * @author Mikiyas A Midru
  * @date March 25th, 2024 12:00 PM
@@ -15,23 +59,43 @@
 #include <vector>
 #include <iostream>
 #include <cstring>
-
-/**
- * Structure to represent an entry in the index file.
-*/
-struct IndexEntry {
-    std::string key;
-    std::streamoff offset;
-};
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "format.h"
+#include "index.h"
+#include "projection.h"
+#include "reader.h"
+#include "scan.h"
+#include "sort.h"
+#include "writer.h"
 
 // Global variable to store index entries
 std::vector<IndexEntry> indexEntries;
 
 // Function prototypes
-void listRecords(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength);
-void searchForKey(const std::string& dataFilename, const std::string& indexFilename, const std::string& key, size_t keyLength);
+void listRecords(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength, bool covered);
+void searchForKey(const std::string& dataFilename, const std::string& indexFilename, const std::string& key, size_t keyLength, bool covered);
+void searchForKeys(const std::string& dataFilename, const std::string& indexFilename, const std::string& keysFilename, size_t keyLength, bool covered, bool keyOrder);
+void listRange(const std::string& dataFilename, const std::string& indexFilename, const std::string& low, const std::string& high, size_t keyLength, bool covered, uint64_t limit);
 void checkOrCreateIndexFile(const std::string& indexFilename);
-void createIndexInMemorySort(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength);
+bool createIndexInMemorySort(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength, const BuildOptions& options);
+bool updateIndex(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength, const BuildOptions& options);
+bool openIndex(IndexReader& index, const std::string& indexFilename, const std::string& dataFilename, size_t keyLength, bool mapped = false, bool warnAppended = true);
+bool readRecord(int dataFd, std::streamoff offset, uint32_t length, std::string& record);
+bool readProjection(int& dataFd, const std::string& dataFilename, const char* stored, const IndexHeader& header, std::string& projected);
+bool parseSize(const std::string& text, size_t& size);
+bool parseCount(const std::string& text, uint64_t maximum, uint64_t& count);
+size_t defaultMemoryBudget();
+size_t defaultThreadCount();
 
 /**
  * The main function of the program.
@@ -39,36 +103,175 @@ void createIndexInMemorySort(const std::string& dataFilename, const std::string&
  * @param argc The number of command-line arguments.
  * @param argv An array of C-style strings containing the command-line arguments.
  *             The first argument is the program name, followed by the mode, data file name, index file name, key length, and optional key.
+ *             Options may appear anywhere after the program name.
  * @return int The exit status of the program.
  */
 int main(int argc, char* argv[]) {
-    if (argc < 5) {
-        std::cerr << "Usage: " << argv[0] << " -c|-l|-s datafile indexfile keylength [key]" << std::endl;
+    // Separate options from positional arguments
+    std::vector<std::string> args;
+    BuildOptions options;
+    options.memoryBudget = defaultMemoryBudget();
+    options.threads = defaultThreadCount();
+    options.layout = kPagedLayout;
+    options.pageSize = kIndexPageSize;
+    options.falsePositiveRate = 0.01;
+    options.alignedEntries = false;
+    ProjectionKind coverKind = kNoProjection;
+    std::string coverList;
+    char delimiter = '\t';
+    uint32_t payloadWidth = 0;
+    bool covered = false;
+    bool keyOrder = false;
+    uint64_t limit = UINT64_MAX;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mem") {
+            if (i + 1 >= argc || !parseSize(argv[++i], options.memoryBudget) || options.memoryBudget == 0) {
+                std::cerr << "Invalid memory budget. Use a byte count with an optional K, M or G suffix, e.g. --mem 2G." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads") {
+            uint64_t threads;
+            if (i + 1 >= argc || !parseCount(argv[++i], kMaxThreads, threads)) {
+                std::cerr << "Invalid thread count. Use a number from 1 to " << kMaxThreads << ", e.g. --threads 8." << std::endl;
+                return 1;
+            }
+            options.threads = static_cast<size_t>(threads);
+        } else if (arg == "--layout") {
+            std::string layout = i + 1 < argc ? argv[++i] : "";
+            if (layout == "flat") {
+                options.layout = kFlatLayout;
+            } else if (layout == "paged") {
+                options.layout = kPagedLayout;
+            } else if (layout == "btree") {
+                options.layout = kBTreeLayout;
+            } else if (layout == "front") {
+                options.layout = kFrontCodedLayout;
+            } else if (layout == "eytzinger") {
+                options.layout = kEytzingerLayout;
+            } else if (layout == "learned") {
+                options.layout = kLearnedLayout;
+            } else if (layout == "hash") {
+                options.layout = kHashLayout;
+            } else if (layout == "table") {
+                options.layout = kTableLayout;
+            } else if (layout == "columnar") {
+                options.layout = kColumnarLayout;
+            } else {
+                std::cerr << "Invalid layout. Use --layout flat, paged, btree, front, eytzinger, learned, hash, table or columnar." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--hash") {
+            options.layout = kTableLayout;
+        } else if (arg == "--aligned") {
+            options.alignedEntries = true;
+        } else if (arg == "--page-size") {
+            size_t& pageSize = options.pageSize;
+            if (i + 1 >= argc || !parseSize(argv[++i], pageSize) || pageSize < 4096 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0) {
+                std::cerr << "Invalid page size. Use a power of two from 4K to 64K, e.g. --page-size 16K." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--bloom") {
+            char* end = nullptr;
+            options.falsePositiveRate = i + 1 < argc ? std::strtod(argv[++i], &end) : -1;
+            if (end == nullptr || *end != '\0' || !(options.falsePositiveRate >= 0 && options.falsePositiveRate < 1)) {
+                std::cerr << "Invalid false positive rate. Use a number from 0 (no filter) to below 1, e.g. --bloom 0.01." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--cover-bytes" || arg == "--cover-fields") {
+            coverKind = arg == "--cover-bytes" ? kByteProjection : kFieldProjection;
+            coverList = i + 1 < argc ? argv[++i] : "";
+        } else if (arg == "--delimiter") {
+            std::string text = i + 1 < argc ? argv[++i] : "";
+            if (text.size() != 1 || text[0] == '\n') {
+                std::cerr << "Invalid delimiter. Use a single character other than a newline, e.g. --delimiter ','." << std::endl;
+                return 1;
+            }
+            delimiter = text[0];
+        } else if (arg == "--cover-width") {
+            uint64_t width;
+            if (i + 1 >= argc || !parseCount(argv[++i], kMaxPayloadWidth, width)) {
+                std::cerr << "Invalid projection width. Use a number of bytes from 1 to " << kMaxPayloadWidth << ", e.g. --cover-width 40." << std::endl;
+                return 1;
+            }
+            payloadWidth = static_cast<uint32_t>(width);
+        } else if (arg == "--covered") {
+            covered = true;
+        } else if (arg == "--key-order") {
+            keyOrder = true;
+        } else if (arg == "--limit") {
+            std::string text = i + 1 < argc ? argv[++i] : "";
+            if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Invalid limit. Use a number of records, e.g. --limit 100." << std::endl;
+                return 1;
+            }
+            limit = std::strtoull(text.c_str(), nullptr, 10);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    std::memset(&options.projection, 0, sizeof(options.projection));
+    options.projection.kind = kNoProjection;
+    if (coverKind != kNoProjection && !parseProjection(coverList, coverKind, delimiter, payloadWidth, options.projection)) {
         return 1;
     }
 
-    std::string mode = argv[1];
-    std::string dataFilename = argv[2];
-    std::string indexFilename = argv[3];
-    size_t keyLength = static_cast<size_t>(std::atoi(argv[4]));
+    if (args.size() < 4) {
+        std::cerr << "Usage: " << argv[0] << " -c|-u|-l|-s|-S|-r|-p datafile indexfile keylength [key|keysfile|low high|prefix] [--mem size] [--threads n] [--layout flat|paged|btree|front|eytzinger|learned|hash|table|columnar] [--hash] [--page-size size] [--bloom rate] [--aligned] [--cover-bytes list|--cover-fields list] [--delimiter c] [--cover-width n] [--covered] [--key-order] [--limit n]" << std::endl;
+        return 1;
+    }
+
+    std::string mode = args[0];
+    std::string dataFilename = args[1];
+    std::string indexFilename = args[2];
+    uint64_t length;
+    if (!parseCount(args[3], UINT32_MAX, length)) {
+        std::cerr << "Invalid key length. Use a positive number of bytes, e.g. 8." << std::endl;
+        return 1;
+    }
+    size_t keyLength = static_cast<size_t>(length);
 
     // Attempt to open the index file
     checkOrCreateIndexFile(indexFilename);
 
 
     if (mode == "-c") {
-        createIndexInMemorySort(dataFilename, indexFilename, keyLength);
+        if (!createIndexInMemorySort(dataFilename, indexFilename, keyLength, options)) {
+            return 1;
+        }
+    } else if (mode == "-u") {
+        if (!updateIndex(dataFilename, indexFilename, keyLength, options)) {
+            return 1;
+        }
     } else if (mode == "-l") {
-        listRecords(dataFilename, indexFilename, keyLength);
+        listRecords(dataFilename, indexFilename, keyLength, covered);
     } else if (mode == "-s") {
-        if (argc != 6) {
+        if (args.size() != 5) {
             std::cerr << "Usage: " << argv[0] << " -s datafile indexfile keylength key" << std::endl;
             return 1;
         }
-        std::string key = argv[5];
-        searchForKey(dataFilename, indexFilename, key, keyLength);
+        std::string key = args[4];
+        searchForKey(dataFilename, indexFilename, key, keyLength, covered);
+    } else if (mode == "-S") {
+        if (args.size() != 5) {
+            std::cerr << "Usage: " << argv[0] << " -S datafile indexfile keylength keysfile|- [--key-order]" << std::endl;
+            return 1;
+        }
+        searchForKeys(dataFilename, indexFilename, args[4], keyLength, covered, keyOrder);
+    } else if (mode == "-r") {
+        if (args.size() != 6) {
+            std::cerr << "Usage: " << argv[0] << " -r datafile indexfile keylength low high [--limit n]" << std::endl;
+            return 1;
+        }
+        listRange(dataFilename, indexFilename, args[4], args[5], keyLength, covered, limit);
+    } else if (mode == "-p") {
+        if (args.size() != 5) {
+            std::cerr << "Usage: " << argv[0] << " -p datafile indexfile keylength prefix [--limit n]" << std::endl;
+            return 1;
+        }
+        listRange(dataFilename, indexFilename, args[4], args[4], keyLength, covered, limit);
     } else {
-        std::cerr << "Invalid mode. Use -c to create index, -l to list records, or -s to search for a key." << std::endl;
+        std::cerr << "Invalid mode. Use -c to create index, -u to update index, -l to list records, -s to search for a key, -S to search for many keys, or -r or -p to list a range of keys." << std::endl;
         return 1;
     }
 
@@ -76,14 +279,83 @@ int main(int argc, char* argv[]) {
 }
 
 /**
- * Compare two IndexEntry objects based on their keys.
+ * Parse a byte count with an optional K, M or G suffix (powers of 1024).
+ * 
+ * @param text The text to parse, e.g. "512M".
+ * @param size Receives the parsed number of bytes.
+ * @return bool True if the text is a valid size, false otherwise.
+ */
+bool parseSize(const std::string& text, size_t& size) {
+    // strtoull would accept leading spaces and a sign, and negate a negative number into a huge one
+    if (text.empty() || text[0] < '0' || text[0] > '9') {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (errno == ERANGE) {
+        return false;
+    }
+
+    std::string suffix(end);
+    if (suffix == "G" || suffix == "g") {
+        value <<= 30;
+    } else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    } else if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+
+    size = static_cast<size_t>(value);
+    return true;
+}
+
+/**
+ * Parse a positive decimal count with an upper bound.
+ *
+ * @param text The text to parse, e.g. "8".
+ * @param maximum The largest count accepted.
+ * @param count Receives the parsed count.
+ * @return bool True if the text is a number from 1 to the maximum and nothing else, false otherwise.
+ */
+bool parseCount(const std::string& text, uint64_t maximum, uint64_t& count) {
+    if (text.empty() || text[0] < '0' || text[0] > '9') {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (errno == ERANGE || *end != '\0' || value == 0 || value > maximum) {
+        return false;
+    }
+    count = value;
+    return true;
+}
+
+/**
+ * Default memory budget for sorting index entries: half of the physical memory.
+ * 
+ * @return size_t The memory budget in bytes.
+ */
+size_t defaultMemoryBudget() {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || pageSize <= 0) {
+        return static_cast<size_t>(1) << 30;
+    }
+    return static_cast<size_t>(pages) / 2 * static_cast<size_t>(pageSize);
+}
+
+/**
+ * Default number of threads for index creation: one per hardware thread.
  * 
- * @param a The first IndexEntry object.
- * @param b The second IndexEntry object.
- * @return bool True if the key of the first object is less than the key of the second object, false otherwise.
+ * @return size_t The thread count.
  */
-bool compareIndexEntries(const IndexEntry& a, const IndexEntry& b) {
-    return a.key < b.key;
+size_t defaultThreadCount() {
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
 }
 
 /**
@@ -99,238 +371,610 @@ void checkOrCreateIndexFile(const std::string& indexFilename) {
 
 /**
  * Create an index file for the data file.
- * The index file contains entries with fixed-length keys and 8-byte offsets to the corresponding records in the data file.
+ * The index file contains entries with fixed-length keys and the offsets and lengths of the corresponding records in
+ * the data file, stored in the fewest bytes that hold the largest offset and length.
  * The keys are extracted from the beginning of each record in the data file.
  * 
- * Sorting approach: In-memory sort using a vector of IndexEntry objects.
+ * Scanning approach: The data file is memory-mapped (or read in blocks if it cannot be mapped) and split into
+ * byte ranges aligned to record boundaries. Each range is scanned in place by its own thread into its own sorter.
+ * 
+ * Covering indexes also store the projection of every record in its entry (see projection.h), taken from the
+ * mapping of the data file as the sorted entries are written.
+ * 
+ * Sorting approach: In-memory parallel radix sort of the entries when they fit in the memory budget, merging the
+ * tables of the ranges. Otherwise sorted runs are spilled next to the index file and k-way merged into it
+ * (see ExternalSorter).
  * 
  * @param dataFilename The name of the data file.
  * @param indexFilename The name of the index file to be created.
  * @param keyLength The length of the keys in the index file.
+ * @param options The memory budget and thread count for the build.
+ * @return bool True if the index was written, false otherwise.
  */
-void createIndexInMemorySort(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength) {
-    std::ifstream dataFile(dataFilename, std::ifstream::binary);
-    if (!dataFile) {
+bool createIndexInMemorySort(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength, const BuildOptions& options) {
+    DataSource dataFile;
+    if (!dataFile.open(dataFilename)) {
         std::cerr << "Error opening data file for reading." << std::endl;
-        return;
+        return false;
     }
-
-    std::vector<IndexEntry> indexEntries;
-    std::string line;
-    std::streamoff offset = 0;
-    
-    // Read each line from the data file
-    while (getline(dataFile, line)) {
-        if (line.length() >= keyLength) {
-            // Extract key of specified length
-            std::string key = line.substr(0, keyLength);
-            // Store key and offset
-            indexEntries.push_back(IndexEntry{key, offset});
-        }
-        // Update offset with the length of the line plus newline character
-        // offset += line.length() + 1;
-        offset = dataFile.tellg();
+    // The payloads are projected from the mapping of the data file
+    if (options.projection.payloadWidth > 0 && dataFile.data() == nullptr && dataFile.size() != 0) {
+        std::cerr << "A covering index needs a data file that can be memory-mapped." << std::endl;
+        return false;
     }
 
-    // Close data file
-    dataFile.close();
+    std::unique_ptr<ExternalSorter> sorter = scanDataFile(dataFile, 0, keyLength, options, indexFilename + ".run");
+    if (!sorter) {
+        return false;
+    }
 
-    // Sort indexEntries by key
-    std::sort(indexEntries.begin(), indexEntries.end(), compareIndexEntries);
+    // Record the data file that was indexed, so readers can detect changes to it (streams cannot be checked)
+    IndexHeader header = makeIndexHeader(keyLength, options.layout);
+    header.pageSize = static_cast<uint32_t>(options.pageSize);
+    header.filterBitsPerKey = options.falsePositiveRate > 0 ? filterBitsPerKey(options.falsePositiveRate) : 0;
+    header.offsetWidth = offsetWidthFor(dataFile.size());
+    header.lengthWidth = lengthWidthFor(sorter->maxRecordLength());
+    header.projection = options.projection;
+    if (options.alignedEntries) {
+        alignIndexEntries(header);
+    }
+    if (dataFile.size() >= 0 && stampDataFile(dataFilename, static_cast<uint64_t>(dataFile.size()), header.data)) {
+        header.flags |= kHasDataStamp;
+    }
 
     // Open index file for writing in binary mode
-    std::ofstream indexFile(indexFilename, std::ofstream::binary);
+    std::fstream indexFile(indexFilename, std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
     if (!indexFile) {
         std::cerr << "Error opening index file for writing." << std::endl;
-        return;
+        return false;
     }
 
-    // Write each IndexEntry to the index file
-    for (const auto& entry : indexEntries) {
-        indexFile.write(entry.key.c_str(), keyLength);
-        indexFile.write(reinterpret_cast<const char*>(&entry.offset), sizeof(entry.offset));
+    // Write the entries sorted by key, merging the spilled runs if there are any
+    if (!writeIndex(indexFile, *sorter, header, dataFile.data(), static_cast<uint64_t>(std::max<std::streamoff>(0, dataFile.size())))) {
+        std::cerr << "Error writing index file." << std::endl;
+        return false;
     }
 
     // Close index file
     indexFile.close();
+    return !indexFile.fail();
+}
+
+/**
+ * Open an index file and check that it can be used with the data file and key length.
+ * 
+ * @param index The reader to open the index file with.
+ * @param indexFilename The name of the index file.
+ * @param dataFilename The name of the data file.
+ * @param keyLength The length of the keys in the index file.
+ * @param mapped Whether to map the index into memory for lookups (see IndexReader::open).
+ * @param warnAppended Whether to warn if records were appended to the data file (see checkIndexHeader).
+ * @return bool True if the index can be used, false otherwise.
+ */
+bool openIndex(IndexReader& index, const std::string& indexFilename, const std::string& dataFilename, size_t keyLength, bool mapped, bool warnAppended) {
+    return index.open(indexFilename, mapped) && checkIndexHeader(index.header(), dataFilename, keyLength, warnAppended);
+}
+
+/**
+ * Bring an index file up to date with records appended to its data file since it was built.
+ * Only the new tail of the data file, after the size recorded in the index header, is scanned. Its entries are sorted and merged in one sequential pass with the
+ * existing index into a temporary file, which then replaces the index.
+ * 
+ * @param dataFilename The name of the data file.
+ * @param indexFilename The name of the index file to be updated.
+ * @param keyLength The length of the keys in the index file.
+ * @param options The memory budget and thread count for the update.
+ * @return bool True if the index is up to date, false otherwise.
+ */
+bool updateIndex(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength, const BuildOptions& options) {
+    // The appended records are what the update indexes, so no warning about them
+    IndexReader index;
+    if (!openIndex(index, indexFilename, dataFilename, keyLength, false, false)) {
+        return false;
+    }
+    IndexHeader header = index.header();
+    if (!(header.flags & kHasDataStamp)) {
+        std::cerr << "The index was built from a stream and cannot be updated. Recreate it with -c." << std::endl;
+        return false;
+    }
+
+    DataSource dataFile;
+    if (!dataFile.open(dataFilename)) {
+        std::cerr << "Error opening data file for reading." << std::endl;
+        return false;
+    }
+    if (dataFile.size() < 0) {
+        std::cerr << "The data file must be a regular file to update its index." << std::endl;
+        return false;
+    }
+
+    // Nothing was appended since the last build
+    std::streamoff indexedLength = static_cast<std::streamoff>(header.data.size);
+    if (indexedLength >= dataFile.size()) {
+        return true;
+    }
+
+    // A last record without a newline may have been extended by the append: it is scanned again, and its old entry,
+    // which has the old length, is left out of the merge
+    std::streamoff resumeOffset = unfinishedRecordStart(dataFile, indexedLength);
+    uint64_t keptEntries = header.entryCount - (static_cast<size_t>(indexedLength - resumeOffset) >= keyLength && resumeOffset < indexedLength ? 1 : 0);
+    // The entries of the hash and table layouts are not sorted, and cannot be merged: the whole data file is
+    // scanned again
+    if (!isSortedLayout(header.layout)) {
+        resumeOffset = 0;
+    }
+
+    std::unique_ptr<ExternalSorter> sorter = scanDataFile(dataFile, resumeOffset, keyLength, options, indexFilename + ".run");
+    if (!sorter) {
+        return false;
+    }
+    if (isSortedLayout(header.layout)) {
+        std::unique_ptr<EntrySource> existingEntries = index.entries();
+        if (!existingEntries) {
+            return false;
+        }
+        sorter->mergeWith(std::unique_ptr<EntrySource>(new OffsetLimitSource(std::move(existingEntries), keyLength, resumeOffset)), keptEntries);
+    }
+    IndexLayout layout = header.layout;
+    uint32_t pageSize = header.pageSize;
+    uint32_t bitsPerKey = header.filterBitsPerKey;
+    bool aligned = (header.flags & kAlignedEntries) != 0;
+    Projection projection = header.projection;
+    // Entries of an index without record lengths keep an unknown length, which needs the widest field
+    uint32_t lengthWidth = std::max<uint32_t>(lengthWidthFor(sorter->maxRecordLength()), header.lengthWidth > 0 ? header.lengthWidth : kRecordLengthSize);
+    header = makeIndexHeader(keyLength, layout);
+    header.pageSize = pageSize;
+    header.filterBitsPerKey = bitsPerKey;
+    header.offsetWidth = offsetWidthFor(dataFile.size());
+    header.lengthWidth = lengthWidth;
+    header.projection = projection;
+    if (aligned) {
+        alignIndexEntries(header);
+    }
+    if (stampDataFile(dataFilename, static_cast<uint64_t>(dataFile.size()), header.data)) {
+        header.flags |= kHasDataStamp;
+    }
+
+    std::string updatedFilename = indexFilename + ".tmp";
+    std::fstream updatedFile(updatedFilename, std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    if (!updatedFile) {
+        std::cerr << "Error opening index file for writing." << std::endl;
+        return false;
+    }
+    if (!writeIndex(updatedFile, *sorter, header, dataFile.data(), static_cast<uint64_t>(dataFile.size()))) {
+        std::cerr << "Error writing index file." << std::endl;
+        std::remove(updatedFilename.c_str());
+        return false;
+    }
+    updatedFile.close();
+
+    // Replace the old index in one step, so readers see either the old or the updated index
+    if (!updatedFile || std::rename(updatedFilename.c_str(), indexFilename.c_str()) != 0) {
+        std::cerr << "Error replacing index file." << std::endl;
+        std::remove(updatedFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read a record of the data file. A record of known length is read with a single read of exactly its bytes;
+ * otherwise the data file is read up to the newline ending the record.
+ *
+ * @param dataFd The data file, open for reading.
+ * @param offset The offset of the record in the data file.
+ * @param length The length of the record without its newline, or kUnknownRecordLength.
+ * @param record Receives the record without its newline.
+ * @return bool False if the data file could not be read, true otherwise.
+ */
+bool readRecord(int dataFd, std::streamoff offset, uint32_t length, std::string& record) {
+    record.clear();
+    if (length != kUnknownRecordLength) {
+        record.resize(length);
+        size_t done = 0;
+        while (done < record.size()) {
+            ssize_t count = pread(dataFd, &record[done], record.size() - done, static_cast<off_t>(offset + done));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            done += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    // The index does not know the length: read up to the newline
+    char buffer[4096];
+    for (;;) {
+        ssize_t count = pread(dataFd, buffer, sizeof(buffer), static_cast<off_t>(offset));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return count == 0;  // The last record of the file may have no newline
+        }
+        const char* newline = static_cast<const char*>(std::memchr(buffer, '\n', static_cast<size_t>(count)));
+        record.append(buffer, newline != nullptr ? static_cast<size_t>(newline - buffer) : static_cast<size_t>(count));
+        if (newline != nullptr) {
+            return true;
+        }
+        offset += count;
+    }
+}
+
+/**
+ * Read the projection of a record from its entry in a covering index, or from the data file if the projection did
+ * not fit in the payload of the entry.
+ * Prints an error if the data file could not be read.
+ *
+ * @param dataFd The data file, -1 until it is first needed, when it is opened.
+ * @param dataFilename The name of the data file.
+ * @param stored The entry of the record in the index file.
+ * @param header The header of the index file.
+ * @param projected Receives the projection of the record.
+ * @return bool False if the data file could not be read, true otherwise.
+ */
+bool readProjection(int& dataFd, const std::string& dataFilename, const char* stored, const IndexHeader& header, std::string& projected) {
+    if (loadStoredPayload(stored, header, projected)) {
+        return true;
+    }
+    if (dataFd < 0) {
+        dataFd = open(dataFilename.c_str(), O_RDONLY);
+        if (dataFd < 0) {
+            std::cerr << "Error opening data file for reading." << std::endl;
+            return false;
+        }
+    }
+    std::string record;
+    if (!readRecord(dataFd, loadStoredOffset(stored, header), loadStoredRecordLength(stored, header), record)) {
+        std::cerr << "Error reading data file." << std::endl;
+        return false;
+    }
+    projectRecord(record.data(), record.size(), header.projection, projected);
+    return true;
 }
 
 /**
  * List records from the data file using the index file.
- * The index file contains entries with fixed-length keys and 8-byte offsets to the corresponding records in the data file.
- * The keys are extracted from the beginning of each record in the data file.
+ * The index file contains entries with fixed-length keys and the offsets and lengths of the corresponding records in
+ * the data file. Each record is read with one read of its exact size. With `covered`, the projections stored in
+ * the entries of a covering index are listed instead, and the data file is only read for the records whose
+ * projection did not fit.
  * 
  * @param dataFilename The name of the data file.
  * @param indexFilename The name of the index file.
  * @param keyLength The length of the keys in the index file.
+ * @param covered Whether to list the projections of the records rather than the records.
  */
-void listRecords(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength) {
-    // Open index file for reading in binary mode
-    std::ifstream indexFile(indexFilename, std::ifstream::binary);
-    if (!indexFile) {
-        std::cerr << "Error opening index file for reading." << std::endl;
+void listRecords(const std::string& dataFilename, const std::string& indexFilename, size_t keyLength, bool covered) {
+    // Open index file for reading and check its header
+    IndexReader index;
+    if (!openIndex(index, indexFilename, dataFilename, keyLength)) {
+        return;
+    }
+    if (covered) {
+        if (index.header().projection.payloadWidth == 0) {
+            std::cerr << "The index stores no projection of its records. Recreate it with -c and --cover-bytes or --cover-fields." << std::endl;
+            return;
+        }
+        // Only the offsets, lengths and payloads are needed, which the columnar layout reads without the keys
+        std::unique_ptr<EntrySource> stored = index.storedEntries(false);
+        if (!stored) {
+            return;
+        }
+        int dataFd = -1;
+        std::string projected;
+        while (stored->next() && readProjection(dataFd, dataFilename, stored->head(), index.header(), projected)) {
+            std::cout << projected << '\n';
+        }
+        if (dataFd >= 0) {
+            close(dataFd);
+        }
+        return;
+    }
+    std::unique_ptr<EntrySource> entries = index.entries(false);
+    if (!entries) {
         return;
     }
 
     // Open data file for reading
-    std::ifstream dataFile(dataFilename);
-    if (!dataFile) {
+    int dataFd = open(dataFilename.c_str(), O_RDONLY);
+    if (dataFd < 0) {
         std::cerr << "Error opening data file for reading." << std::endl;
         return;
     }
 
-    // Read each entry from the index file
-    while (indexFile.good()) {
-        // Allocate memory for reading the key from the file
-        char* buffer = new char[keyLength];
-        // Read the key from the file into the buffer
-        indexFile.read(buffer, keyLength);
-
-        if (indexFile.gcount() < static_cast<std::streamsize>(keyLength)) {
-            delete[] buffer;
-            break;  // End of file or error
-        }
-
+    // Read each entry from the index file, in the order of the index whatever its layout (the hash and table layouts are unsorted)
+    std::string record;
+    while (entries->next()) {
         std::streamoff offset;
-        // Read the offset from the file
-        indexFile.read(reinterpret_cast<char*>(&offset), sizeof(offset));
-
-        if (!indexFile.good()) {
-            delete[] buffer;
-            break;  // End of file or error
+        uint32_t length;
+        std::memcpy(&offset, entries->head() + keyLength, sizeof(offset));
+        std::memcpy(&length, entries->head() + keyLength + sizeof(offset), sizeof(length));
+
+        // Read the record from the data file
+        if (!readRecord(dataFd, offset, length, record)) {
+            std::cerr << "Error reading data file." << std::endl;
+            break;
         }
 
-        // Seek in the data file and read the record
-        dataFile.seekg(offset);
-        std::string record;
-        getline(dataFile, record);
-
         // Print the record
         std::cout << record << std::endl;
-
-        delete[] buffer;
     }
 
-    // Close the files
-    indexFile.close();
-    dataFile.close();
+    // Close the data file
+    close(dataFd);
 }
 
 /**
- * Search for a record by key in the index file.
- * The index file contains entries with fixed-length keys and 8-byte offsets to the corresponding records in the data file.
- * The keys are extracted from the beginning of each record in the data file.
+ * Search for the records with a key in the index file.
+ * The index file contains entries with fixed-length keys and the offsets and lengths of the corresponding records in
+ * the data file. Every record found is read with one read of its exact size.
+ * The index is mapped into memory and searched in place (see IndexReader), so the search makes no reads of the
+ * index file, and touches one entry per probe of a binary search in the flat layout and one page in the paged
+ * layout. The entries of the key follow the first one in the sorted layouts (see IndexReader::findAll), and their
+ * records are read in the order of their offsets and printed in that order, which is the order of the data file.
+ * With `covered`, the projections stored in the entries of a covering index are printed instead, without reading
+ * the data file unless a projection did not fit.
  * @param dataFilename The name of the data file.
  * @param indexFilename The name of the index file.
  * @param key The key to search for.
  * @param keyLength The length of the keys in the index file.
+ * @param covered Whether to print the projection of the record rather than the record.
 */
-void searchForKey(const std::string& dataFilename, const std::string& indexFilename, const std::string& key, size_t keyLength) {
-    // Open index file for reading in binary mode
-    std::ifstream indexFile(indexFilename, std::ifstream::binary);
-    if (!indexFile) {
-        std::cerr << "Error opening index file for reading." << std::endl;
+void searchForKey(const std::string& dataFilename, const std::string& indexFilename, const std::string& key, size_t keyLength, bool covered) {
+    // Map the index file and check its header
+    IndexReader index;
+    if (!openIndex(index, indexFilename, dataFilename, keyLength, true)) {
         return;
     }
-
-    // Open data file for reading
-    std::ifstream dataFile(dataFilename);
-    if (!dataFile) {
-        std::cerr << "Error opening data file for reading." << std::endl;
+    const IndexHeader& header = index.header();
+    if (covered && header.projection.payloadWidth == 0) {
+        std::cerr << "The index stores no projection of its records. Recreate it with -c and --cover-bytes or --cover-fields." << std::endl;
         return;
     }
 
-    // Get the size of the index file
-    indexFile.seekg(0, std::ios::end);
-
-    std::streamoff fileSize = indexFile.tellg();
-
-    indexFile.seekg(0, std::ios::beg);
-
-    /**
-     * Calculate the number of records in the index file
-     * 
-     * sizeof(std::streamoff) is 4 bytes (32 bits) or 8 bytes (64 bits) depending on the system architecture.
-     * 
-     * For example, if the file size is 100 bytes,
-     * the key length is 10 bytes, and the size of a std::streamoff object is 8 bytes,
-     * then the number of records in the file would be calculated as follows:
-     * numRecords = 100 / (10 + 8) = 100 / 18 = 5 records in the index file
-    */
-    size_t numRecords = fileSize / (keyLength + sizeof(std::streamoff));
-    
-    // Perform a binary search for the key
-    size_t low = 0;
-    size_t high = numRecords;
-    bool found = false;
-    std::streamoff recordOffset = 0;
-    
-    while (low < high) {  // Loop until the search range is narrowed down
-        size_t mid = low + (high - low) / 2;  // Calculate the middle index to avoid overflow
-
-        /**
-        * Seek to the position of the key(mid) in the index file
-        * On most 32-bit systems, sizeof(std::streamoff) is 4 bytes (32 bits). 
-        * On 64-bit systems, it is 8 bytes (64 bits).
-        * This size allows std::streamoff to represent large file offsets,
-        * necessary for working with very large files.
-        * 
-        * For example, if the index file contains 10 records,
-        * the key length is 10 bytes, and the size of a std::streamoff object is 8 bytes,
-        * then the offset to the middle record would be calculated as follows:
-        * 
-        * - mid * (keyLength + sizeof(std::streamoff)) = 5 * (10 + 8) = 90 bytes
-        * 
-        * The seekg() function then seeks to the specified offset in the index file.
-        * This allows the program to read the middle record from the file.
-        */
-        indexFile.seekg(mid * (keyLength + sizeof(std::streamoff)));
-
-        // Allocate memory for reading the key from the file
-        char* buffer = new char[keyLength];
-        // Read the key from the file into the buffer
-        indexFile.read(buffer, keyLength);
-        // Create a string from the buffer to compare with the search key
-        std::string currentKey(buffer, keyLength);
-        // Deallocate the buffer memory
-        delete[] buffer;
-
-        // Compare the current key with the search key to determine the next step
-        if (currentKey < key) {
-            // If currentKey is less than the search key, search in the upper half
-            low = mid + 1;
-        } else if (currentKey > key) {
-            // If currentKey is greater than the search key, search in the lower half
-            high = mid;
-        } else {
-            // If currentKey equals the search key, the record is found
-            found = true;
-            /**
-             * Read the associated record offset following the key
-             * The sizeof() operator is used to determine the size of the variable recordOffset. 
-             * This is necessary because the read() function needs to know how many bytes to read from the file.
-             * 
-             * read the value of the variable recordOffset from the file indexFile and store it 
-             * in the variable recordOffset. This will be used for reading data from a binary file
-            */
-            indexFile.read(reinterpret_cast<char*>(&recordOffset), sizeof(recordOffset));
-            break;  // Exit the loop as the target record is found
-        }
-    }
-
-
-    // If found, seek in the data file and read the record
-    if (found) {
-        dataFile.seekg(recordOffset, std::ios::beg);
-        std::string record;
-        std::getline(dataFile, record);
-        std::cout << record << std::endl;
-    } else {
+    std::vector<char> entries;
+    if (!index.findAll(key, entries)) {
+        return;
+    }
+    if (entries.empty()) {
         std::cout << "Record not found" << std::endl;
+        return;
     }
 
-    // Close the files
-    indexFile.close();
-    dataFile.close();
+    // Read the records of the key in the order of their offsets, so the data file is read front to back
+    const size_t stride = storedEntryStride(header);
+    std::vector<const char*> found;
+    for (size_t position = 0; position < entries.size(); position += stride) {
+        found.push_back(&entries[position]);
+    }
+    std::stable_sort(found.begin(), found.end(), [&](const char* a, const char* b) {
+        return loadStoredOffset(a, header) < loadStoredOffset(b, header);
+    });
+
+    int dataFd = -1;
+    std::string record;
+    for (const char* entry : found) {
+        if (covered) {
+            if (!readProjection(dataFd, dataFilename, entry, header, record)) {
+                break;
+            }
+            std::cout << record << '\n';
+            continue;
+        }
+        if (dataFd < 0) {
+            dataFd = open(dataFilename.c_str(), O_RDONLY);
+            if (dataFd < 0) {
+                std::cerr << "Error opening data file for reading." << std::endl;
+                return;
+            }
+        }
+        if (!readRecord(dataFd, loadStoredOffset(entry, header), loadStoredRecordLength(entry, header), record)) {
+            std::cerr << "Error reading data file." << std::endl;
+            break;
+        }
+        std::cout << record << '\n';
+    }
+
+    // Close the data file
+    if (dataFd >= 0) {
+        close(dataFd);
+    }
+}
+
+/**
+ * Search for the records of many keys, read one per line from a file or from standard input.
+ * The distinct keys are sorted and searched in one pass over the mapped index, each from where the previous one was
+ * found (see IndexReader::findSorted), and the records of all of them are then read from the data file in the order
+ * of their offsets. For every key read, its records are printed in the order of the data file, as -s prints them, or
+ * "Record not found".
+ * @param dataFilename The name of the data file.
+ * @param indexFilename The name of the index file.
+ * @param keysFilename The name of the file of keys, or "-" for standard input.
+ * @param keyLength The length of the keys in the index file.
+ * @param covered Whether to print the projections of the records rather than the records.
+ * @param keyOrder Whether to print the results in key order rather than in the order the keys were read.
+*/
+void searchForKeys(const std::string& dataFilename, const std::string& indexFilename, const std::string& keysFilename, size_t keyLength, bool covered, bool keyOrder) {
+    // Read the keys
+    std::ifstream keysFile;
+    if (keysFilename != "-") {
+        keysFile.open(keysFilename.c_str());
+        if (!keysFile) {
+            std::cerr << "Error opening keys file for reading." << std::endl;
+            return;
+        }
+    }
+    std::istream& input = keysFilename != "-" ? keysFile : std::cin;
+    std::vector<std::string> keys;
+    std::string line;
+    while (std::getline(input, line)) {
+        keys.push_back(line);
+    }
+
+    // Map the index file and check its header
+    IndexReader index;
+    if (!openIndex(index, indexFilename, dataFilename, keyLength, true)) {
+        return;
+    }
+    const IndexHeader& header = index.header();
+    if (covered && header.projection.payloadWidth == 0) {
+        std::cerr << "The index stores no projection of its records. Recreate it with -c and --cover-bytes or --cover-fields." << std::endl;
+        return;
+    }
+
+    // Search the distinct keys in sorted order; std::string compares bytes as unsigned, like the index
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    std::vector<std::string> sortedKeys;
+    std::vector<size_t> distinct(keys.size());  // Position of every key read among the sorted distinct keys
+    for (size_t i : order) {
+        if (sortedKeys.empty() || sortedKeys.back() != keys[i]) {
+            sortedKeys.push_back(keys[i]);
+        }
+        distinct[i] = sortedKeys.size() - 1;
+    }
+    std::vector<char> entries;
+    std::vector<uint64_t> runs;
+    if (!index.findSorted(sortedKeys, entries, runs)) {
+        return;
+    }
+
+    // Read the records found in the order of their offsets, so the data file is read front to back
+    const size_t stride = storedEntryStride(header);
+    const size_t entryCount = entries.size() / stride;
+    std::vector<std::pair<std::streamoff, size_t> > reads(entryCount);
+    for (size_t i = 0; i < entryCount; ++i) {
+        reads[i] = std::make_pair(loadStoredOffset(&entries[i * stride], header), i);
+    }
+    std::sort(reads.begin(), reads.end());
+    std::vector<std::string> results(entryCount);
+    int dataFd = -1;
+    bool readAll = true;
+    for (const auto& read : reads) {
+        const char* stored = &entries[read.second * stride];
+        if (covered) {
+            readAll = readProjection(dataFd, dataFilename, stored, header, results[read.second]);
+            if (!readAll) {
+                break;
+            }
+            continue;
+        }
+        if (dataFd < 0) {
+            dataFd = open(dataFilename.c_str(), O_RDONLY);
+            if (dataFd < 0) {
+                std::cerr << "Error opening data file for reading." << std::endl;
+                return;
+            }
+        }
+        readAll = readRecord(dataFd, read.first, loadStoredRecordLength(stored, header), results[read.second]);
+        if (!readAll) {
+            std::cerr << "Error reading data file." << std::endl;
+            break;
+        }
+    }
+    if (dataFd >= 0) {
+        close(dataFd);
+    }
+    if (!readAll) {
+        return;
+    }
+
+    // The records of every key in the order of the data file
+    std::vector<size_t> printed(entryCount);
+    for (size_t i = 0; i < entryCount; ++i) {
+        printed[i] = i;
+    }
+    for (size_t key = 0; key < sortedKeys.size(); ++key) {
+        std::stable_sort(printed.begin() + runs[key], printed.begin() + runs[key + 1], [&](size_t a, size_t b) {
+            return loadStoredOffset(&entries[a * stride], header) < loadStoredOffset(&entries[b * stride], header);
+        });
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t key = distinct[keyOrder ? order[i] : i];
+        if (runs[key] == runs[key + 1]) {
+            std::cout << "Record not found" << '\n';
+        }
+        for (uint64_t entry = runs[key]; entry < runs[key + 1]; ++entry) {
+            std::cout << results[printed[entry]] << '\n';
+        }
+    }
 }
 
+/**
+ * List the records whose keys are in a range, in key order.
+ * The first entry of the range is searched for in the mapped index as a key is (see IndexReader::storedEntriesFrom),
+ * and the entries from there on are read in order until the upper bound, so the cost is that of one search plus
+ * the entries listed. Both bounds are compared with as many leading bytes of the keys as they have, so a bound
+ * shorter than the keys covers every key it is a prefix of, and a prefix query is a range from the prefix to itself.
+ * @param dataFilename The name of the data file.
+ * @param indexFilename The name of the index file.
+ * @param low The smallest key listed, or the prefix of the smallest keys listed.
+ * @param high The largest key listed, or the prefix of the largest keys listed.
+ * @param keyLength The length of the keys in the index file.
+ * @param covered Whether to print the projections of the records rather than the records.
+ * @param limit The largest number of records listed.
+*/
+void listRange(const std::string& dataFilename, const std::string& indexFilename, const std::string& low, const std::string& high, size_t keyLength, bool covered, uint64_t limit) {
+    if (low.size() > keyLength || high.size() > keyLength) {
+        std::cerr << "Invalid range. Use bounds of at most " << keyLength << " bytes, the key length." << std::endl;
+        return;
+    }
+
+    // Map the index file and check its header
+    IndexReader index;
+    if (!openIndex(index, indexFilename, dataFilename, keyLength, true)) {
+        return;
+    }
+    const IndexHeader& header = index.header();
+    if (!isSortedLayout(header.layout)) {
+        std::cerr << "The index is not sorted and cannot list ranges of keys. Recreate it with -c and a sorted layout." << std::endl;
+        return;
+    }
+    if (covered && header.projection.payloadWidth == 0) {
+        std::cerr << "The index stores no projection of its records. Recreate it with -c and --cover-bytes or --cover-fields." << std::endl;
+        return;
+    }
+    std::unique_ptr<EntrySource> stored = index.storedEntriesFrom(low);
+    if (!stored) {
+        return;
+    }
+
+    int dataFd = -1;
+    std::string record;
+    for (uint64_t listed = 0; listed < limit && stored->next(); ++listed) {
+        const char* entry = stored->head();
+        if (std::memcmp(entry, high.data(), high.size()) > 0) {
+            break;
+        }
+        if (covered) {
+            if (!readProjection(dataFd, dataFilename, entry, header, record)) {
+                break;
+            }
+            std::cout << record << '\n';
+            continue;
+        }
+        if (dataFd < 0) {
+            dataFd = open(dataFilename.c_str(), O_RDONLY);
+            if (dataFd < 0) {
+                std::cerr << "Error opening data file for reading." << std::endl;
+                return;
+            }
+        }
+        if (!readRecord(dataFd, loadStoredOffset(entry, header), loadStoredRecordLength(entry, header), record)) {
+            std::cerr << "Error reading data file." << std::endl;
+            break;
+        }
+        std::cout << record << '\n';
+    }
+    if (dataFd >= 0) {
+        close(dataFd);
+    }
+}
@@ -0,0 +1,102 @@
+/**
+ * Construction of minimal perfect hash functions.
+ * See mphf.h for an overview.
+*/
+#include "mphf.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Smallest number of keys handled by its own thread.
+const size_t kMinKeysPerThread = 1 << 16;
+
+/**
+ * Run a task over `count` items split into one contiguous part per thread. The task receives the part number and
+ * the range of items of the part.
+ */
+template <typename Task>
+void forEachPart(size_t count, size_t parts, Task task) {
+    if (parts <= 1) {
+        task(0, 0, count);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (size_t part = 0; part < parts; ++part) {
+        threads.push_back(std::thread(task, part, count * part / parts, count * (part + 1) / parts));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+} // namespace
+
+std::vector<char> buildPerfectHash(std::vector<uint64_t>& hashes, size_t threads, uint32_t& levels) {
+    std::vector<uint64_t> levelBits;
+    std::vector<uint64_t> words;
+    std::vector<uint64_t> remaining;
+    remaining.swap(hashes);
+
+    for (uint32_t level = 0; level < kMaxHashLevels && !remaining.empty(); ++level) {
+        const uint64_t bits = (static_cast<uint64_t>(kHashGamma * static_cast<double>(remaining.size())) + 64) / 64 * 64;
+        const size_t parts = std::max<size_t>(1, std::min(threads, remaining.size() / kMinKeysPerThread));
+        std::vector<uint64_t> taken(static_cast<size_t>(bits / 64), 0);
+        std::vector<uint64_t> collided(taken.size(), 0);
+
+        // Set the bit of every key, marking the bits set twice
+        forEachPart(remaining.size(), parts, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint64_t bit = levelBit(remaining[i], level, bits);
+                uint64_t mask = static_cast<uint64_t>(1) << (bit % 64);
+                if (__atomic_fetch_or(&taken[bit / 64], mask, __ATOMIC_RELAXED) & mask) {
+                    __atomic_fetch_or(&collided[bit / 64], mask, __ATOMIC_RELAXED);
+                }
+            }
+        });
+
+        // Keep the bits of the keys alone at them, and pass the other keys on to the next level in their order
+        std::vector<std::vector<uint64_t> > next(parts);
+        forEachPart(remaining.size(), parts, [&](size_t part, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint64_t bit = levelBit(remaining[i], level, bits);
+                if ((collided[bit / 64] >> (bit % 64)) & 1) {
+                    next[part].push_back(remaining[i]);
+                }
+            }
+        });
+        for (size_t i = 0; i < taken.size(); ++i) {
+            taken[i] &= ~collided[i];
+        }
+        words.insert(words.end(), taken.begin(), taken.end());
+        levelBits.push_back(bits);
+
+        remaining.clear();
+        for (const auto& part : next) {
+            remaining.insert(remaining.end(), part.begin(), part.end());
+        }
+    }
+
+    levels = static_cast<uint32_t>(levelBits.size());
+    std::vector<char> stored(PerfectHash::storedSize(levels, words.size()));
+    char* position = stored.data();
+    for (uint64_t bits : levelBits) {
+        storeLittleEndian(position, bits, 8);
+        position += 8;
+    }
+    for (uint64_t word : words) {
+        storeLittleEndian(position, word, 8);
+        position += 8;
+    }
+    uint64_t rank = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (i % kRankInterval == 0) {
+            storeLittleEndian(position, rank, 8);
+            position += 8;
+        }
+        rank += static_cast<uint64_t>(__builtin_popcountll(words[i]));
+    }
+    storeLittleEndian(position, rank, 8);
+    return stored;
+}
@@ -0,0 +1,146 @@
+/**
+ * Minimal perfect hash function over the distinct keys of an index, for the hash layout.
+ *
+ * The function maps each of n distinct keys to its own number below n, so an entry stored at that position is
+ * found with a single read. It is built in the manner of BBHash: every key is hashed into a bit array of about
+ * kHashGamma bits per key, and the keys that share a bit with no other key keep it; the others move on to the
+ * next, smaller level. A key is numbered by the count of kept bits before its bit over all levels, which a sample
+ * of that count every kRankInterval words answers with a few population counts. Keys still colliding after
+ * kMaxHashLevels levels, which only happens to keys whose 64-bit hashes are equal, are numbered after the others.
+ *
+ * The stored function is the size in bits of every level, 8 bytes each, followed by the bit arrays of all levels
+ * as little-endian 64-bit words, followed by the rank samples: the number of kept bits before every
+ * kRankInterval-th word as 8 bytes, and the total number of kept bits last.
+*/
+#ifndef MPHF_H
+#define MPHF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "filter.h"
+#include "format.h"
+
+// Size of the bit array of a level in bits per key placed at that level.
+const double kHashGamma = 2.0;
+// Most levels of a function.
+const uint32_t kMaxHashLevels = 32;
+// Number of 64-bit words between rank samples.
+const uint64_t kRankInterval = 8;
+
+/**
+ * Bit of a level a key hashes to: the key hash remixed with the level number, scaled to the size of the level.
+ *
+ * @param hash The hash of the key (see hashKey).
+ * @param level The level, counting from 0.
+ * @param bits The size of the level in bits.
+ * @return uint64_t The bit number within the level.
+ */
+inline uint64_t levelBit(uint64_t hash, uint32_t level, uint64_t bits) {
+    uint64_t mixed = mixBits(hash + (level + 1) * 0x9E3779B97F4A7C15ULL);
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(mixed) * bits) >> 64);
+}
+
+/**
+ * Stored minimal perfect hash function, used in place: the levels are read when it is opened, and the bit arrays
+ * and rank samples are read from the stored bytes at every lookup.
+ */
+class PerfectHash {
+public:
+    PerfectHash() : levelCount(0), words(nullptr), ranks(nullptr), wordCount(0), placed(0) {}
+
+    /**
+     * Use a stored function.
+     *
+     * @param stored The stored function, which must stay valid while the function is used.
+     * @param length The number of bytes available.
+     * @param levels The number of levels of the function.
+     * @return bool False if the stored function is truncated or corrupt, true otherwise.
+     */
+    bool open(const char* stored, size_t length, uint32_t levels) {
+        if (levels > kMaxHashLevels || length < levels * 8) {
+            return false;
+        }
+        levelCount = levels;
+        wordCount = 0;
+        for (uint32_t level = 0; level < levels; ++level) {
+            levelBits[level] = loadLittleEndian(stored + level * 8, 8);
+            levelStart[level] = wordCount * 64;
+            if (levelBits[level] % 64 != 0 || levelBits[level] == 0) {
+                return false;
+            }
+            wordCount += levelBits[level] / 64;
+        }
+        if (length < storedSize(levels, wordCount)) {
+            return false;
+        }
+        words = stored + levels * 8;
+        ranks = words + wordCount * 8;
+        placed = loadLittleEndian(ranks + (wordCount + kRankInterval - 1) / kRankInterval * 8, 8);
+        return true;
+    }
+
+    /**
+     * Number of a key.
+     *
+     * @param hash The hash of the key (see hashKey).
+     * @return uint64_t The number of the key below placedCount(), or placedCount() if the key was not placed at
+     *                  any level. Keys the function was not built over get an arbitrary number.
+     */
+    uint64_t slot(uint64_t hash) const {
+        for (uint32_t level = 0; level < levelCount; ++level) {
+            uint64_t bit = levelStart[level] + levelBit(hash, level, levelBits[level]);
+            uint64_t word = loadLittleEndian(words + bit / 64 * 8, 8);
+            if ((word >> (bit % 64)) & 1) {
+                // Count the kept bits before this one, from the last rank sample
+                uint64_t sample = bit / 64 / kRankInterval;
+                uint64_t rank = loadLittleEndian(ranks + sample * 8, 8);
+                for (uint64_t i = sample * kRankInterval; i < bit / 64; ++i) {
+                    rank += static_cast<uint64_t>(__builtin_popcountll(loadLittleEndian(words + i * 8, 8)));
+                }
+                return rank + static_cast<uint64_t>(__builtin_popcountll(word & ((static_cast<uint64_t>(1) << (bit % 64)) - 1)));
+            }
+        }
+        return placed;
+    }
+
+    /**
+     * @return uint64_t The number of keys placed at some level, which are numbered from 0.
+     */
+    uint64_t placedCount() const { return placed; }
+
+    /**
+     * Size of a stored function.
+     *
+     * @param levels The number of levels.
+     * @param wordCount The number of 64-bit words of all levels.
+     * @return size_t The size in bytes.
+     */
+    static size_t storedSize(uint32_t levels, uint64_t wordCount) {
+        return static_cast<size_t>(levels * 8 + wordCount * 8 + ((wordCount + kRankInterval - 1) / kRankInterval + 1) * 8);
+    }
+
+private:
+    uint32_t levelCount;
+    uint64_t levelBits[kMaxHashLevels];
+    uint64_t levelStart[kMaxHashLevels];  // Number of the first bit of every level
+    const char* words;
+    const char* ranks;
+    uint64_t wordCount;
+    uint64_t placed;
+};
+
+/**
+ * Build a minimal perfect hash function over keys, given their hashes.
+ * Every level is built by all threads at once: the keys are split between the threads, which set the bits of
+ * their keys with atomic operations, and then collect the keys that collided for the next level.
+ *
+ * @param hashes The hashes of the distinct keys (see hashKey); the vector is emptied.
+ * @param threads The number of threads to build with.
+ * @param levels Receives the number of levels of the function.
+ * @return std::vector<char> The stored function (see PerfectHash).
+ */
+std::vector<char> buildPerfectHash(std::vector<uint64_t>& hashes, size_t threads, uint32_t& levels);
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * Vectorized search for record boundaries.
+ * See newline.h for an overview.
+*/
+#include "newline.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEWLINE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/**
+ * Byte-at-a-time search, used for block tails and on processors without a vector implementation.
+ */
+size_t findNewlinesScalar(const char* data, size_t length, uint32_t* positions) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] == '\n') {
+            positions[count++] = static_cast<uint32_t>(i);
+        }
+    }
+    return count;
+}
+
+/**
+ * Append the positions of the set bits of a comparison mask covering the bytes starting at base.
+ */
+inline size_t appendMaskPositions(uint64_t mask, size_t base, uint32_t* positions, size_t count) {
+    while (mask != 0) {
+        positions[count++] = static_cast<uint32_t>(base + __builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+#ifdef NEWLINE_X86
+
+__attribute__((target("sse2")))
+size_t findNewlinesSse2(const char* data, size_t length, uint32_t* positions) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+        count = appendMaskPositions(mask, i, positions, count);
+    }
+    size_t tail = findNewlinesScalar(data + i, length - i, positions + count);
+    for (size_t j = count; j < count + tail; ++j) {
+        positions[j] += static_cast<uint32_t>(i);
+    }
+    return count + tail;
+}
+
+__attribute__((target("avx2")))
+size_t findNewlinesAvx2(const char* data, size_t length, uint32_t* positions) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    // Two vectors per iteration give one 64-bit mask, like the AVX-512 loop
+    for (; i + 64 <= length; i += 64) {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        uint64_t lowMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)));
+        uint64_t highMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)));
+        count = appendMaskPositions(lowMask | (highMask << 32), i, positions, count);
+    }
+    size_t tail = findNewlinesSse2(data + i, length - i, positions + count);
+    for (size_t j = count; j < count + tail; ++j) {
+        positions[j] += static_cast<uint32_t>(i);
+    }
+    return count + tail;
+}
+
+__attribute__((target("avx512f,avx512bw,bmi2")))
+size_t findNewlinesAvx512(const char* data, size_t length, uint32_t* positions) {
+    const __m512i newline = _mm512_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m512i bytes = _mm512_loadu_si512(reinterpret_cast<const void*>(data + i));
+        count = appendMaskPositions(_mm512_cmpeq_epi8_mask(bytes, newline), i, positions, count);
+    }
+    // The tail is handled with a masked load instead of a scalar loop
+    if (i < length) {
+        __mmask64 valid = _bzhi_u64(~0ULL, static_cast<unsigned>(length - i));
+        __m512i bytes = _mm512_maskz_loadu_epi8(valid, data + i);
+        count = appendMaskPositions(_mm512_mask_cmpeq_epi8_mask(valid, bytes, newline), i, positions, count);
+    }
+    return count;
+}
+
+#endif
+
+/**
+ * Pick the fastest implementation the processor supports.
+ */
+NewlineFinder selectNewlineFinder() {
+    std::vector<NewlineScanner> scanners = supportedNewlineScanners();
+    return scanners.back().find;
+}
+
+} // namespace
+
+size_t findNewlines(const char* data, size_t length, uint32_t* positions) {
+    static const NewlineFinder finder = selectNewlineFinder();
+    return finder(data, length, positions);
+}
+
+std::vector<NewlineScanner> supportedNewlineScanners() {
+    std::vector<NewlineScanner> scanners;
+    NewlineScanner scalar = { "scalar", findNewlinesScalar };
+    scanners.push_back(scalar);
+#ifdef NEWLINE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        NewlineScanner sse2 = { "sse2", findNewlinesSse2 };
+        scanners.push_back(sse2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        NewlineScanner avx2 = { "avx2", findNewlinesAvx2 };
+        scanners.push_back(avx2);
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("bmi2")) {
+        NewlineScanner avx512 = { "avx512", findNewlinesAvx512 };
+        scanners.push_back(avx512);
+    }
+#endif
+    return scanners;
+}
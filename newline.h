@@ -0,0 +1,47 @@
+/**
+ * Vectorized search for record boundaries.
+ *
+ * Records in the data file end with a newline. findNewlines reports the position of every newline in a block in
+ * one pass, comparing 16, 32 or 64 bytes at a time with SSE2, AVX2 or AVX-512 depending on what the processor
+ * supports. The implementation is picked once, at the first call.
+*/
+#ifndef NEWLINE_H
+#define NEWLINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Signature shared by the newline search implementations.
+ *
+ * @param data The block to search.
+ * @param length The length of the block in bytes, at most 4 GiB.
+ * @param positions Receives the offset of each newline within the block, in increasing order.
+ *                  Must have room for one position per byte of the block.
+ * @return size_t The number of newlines found.
+ */
+typedef size_t (*NewlineFinder)(const char* data, size_t length, uint32_t* positions);
+
+/**
+ * A newline search implementation and the name of the instruction set it uses.
+ */
+struct NewlineScanner {
+    const char* name;
+    NewlineFinder find;
+};
+
+/**
+ * Find the positions of all newlines in a block using the fastest implementation for this processor.
+ * See NewlineFinder for the parameters.
+ */
+size_t findNewlines(const char* data, size_t length, uint32_t* positions);
+
+/**
+ * List the implementations the processor can run, from slowest to fastest.
+ *
+ * @return std::vector<NewlineScanner> The supported implementations.
+ */
+std::vector<NewlineScanner> supportedNewlineScanners();
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * Projections of records.
+ * See projection.h for an overview.
+*/
+#include "projection.h"
+
+#include "format.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/**
+ * Parse a position of a range: a number from 1 to kProjectionEnd - 1.
+ */
+bool parsePosition(const std::string& text, uint32_t& position) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    unsigned long long value = std::strtoull(text.c_str(), nullptr, 10);
+    if (value == 0 || value >= kProjectionEnd) {
+        return false;
+    }
+    position = static_cast<uint32_t>(value);
+    return true;
+}
+
+} // namespace
+
+bool parseProjection(const std::string& list, ProjectionKind kind, char delimiter, uint32_t payloadWidth, Projection& projection) {
+    std::vector<std::pair<uint32_t, uint32_t> > ranges;
+    for (size_t start = 0; start <= list.size(); ) {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string item = list.substr(start, end - start);
+        size_t dash = item.find('-');
+        uint32_t first = 1, last = kProjectionEnd;
+        bool valid;
+        if (dash == std::string::npos) {
+            valid = parsePosition(item, first);
+            last = first;
+        } else {
+            valid = item.size() > 1 && (dash == 0 || parsePosition(item.substr(0, dash), first)) &&
+                (dash + 1 == item.size() || parsePosition(item.substr(dash + 1), last));
+        }
+        if (!valid || first > last) {
+            std::cerr << "Invalid projection \"" << list << "\". Use positions counting from 1 separated by commas, "
+                      << "with N-M, N- or -M for ranges, e.g. 1-8,12." << std::endl;
+            return false;
+        }
+        ranges.push_back(std::make_pair(first, last));
+        start = end + 1;
+    }
+
+    // Keep the ranges in record order, merging those that touch
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<uint32_t, uint32_t> > merged;
+    for (const auto& range : ranges) {
+        if (!merged.empty() && (merged.back().second == kProjectionEnd || range.first <= merged.back().second + 1)) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    if (merged.size() > kMaxProjectionRanges) {
+        std::cerr << "Invalid projection \"" << list << "\". Use at most " << kMaxProjectionRanges << " ranges." << std::endl;
+        return false;
+    }
+
+    std::memset(&projection, 0, sizeof(projection));
+    projection.kind = kind;
+    projection.delimiter = delimiter;
+    projection.rangeCount = static_cast<uint32_t>(merged.size());
+    uint64_t size = 0;
+    for (size_t i = 0; i < merged.size(); ++i) {
+        projection.ranges[i][0] = merged[i].first;
+        projection.ranges[i][1] = merged[i].second;
+        size += static_cast<uint64_t>(merged[i].second) - merged[i].first + 1;
+    }
+    if (payloadWidth == 0) {
+        // Byte ranges that end within the record bound the size of its projection
+        bool bounded = kind == kByteProjection && merged.back().second != kProjectionEnd;
+        payloadWidth = bounded ? static_cast<uint32_t>(std::min<uint64_t>(size, kMaxPayloadWidth)) : kDefaultPayloadWidth;
+    }
+    projection.payloadWidth = payloadWidth;
+    return true;
+}
+
+void projectRecord(const char* record, size_t length, const Projection& projection, std::string& projected) {
+    projected.clear();
+    if (projection.kind == kByteProjection) {
+        for (uint32_t i = 0; i < projection.rangeCount && projection.ranges[i][0] <= length; ++i) {
+            size_t first = projection.ranges[i][0] - 1;
+            size_t last = std::min<size_t>(projection.ranges[i][1], length);
+            projected.append(record + first, last - first);
+        }
+        return;
+    }
+
+    // Walk the fields up to the end of the last range
+    const char* field = record;
+    const char* end = record + length;
+    uint32_t range = 0;
+    bool first = true;
+    for (uint32_t number = 1; range < projection.rangeCount; ++number) {
+        const char* fieldEnd = static_cast<const char*>(std::memchr(field, projection.delimiter, static_cast<size_t>(end - field)));
+        if (fieldEnd == nullptr) {
+            fieldEnd = end;
+        }
+        if (number >= projection.ranges[range][0]) {
+            if (!first) {
+                projected += projection.delimiter;
+            }
+            projected.append(field, static_cast<size_t>(fieldEnd - field));
+            first = false;
+            if (number == projection.ranges[range][1]) {
+                ++range;
+            }
+        }
+        if (fieldEnd == end) {
+            break;
+        }
+        field = fieldEnd + 1;
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * Projections of records: the part of every record a covering index stores in the entry of the record.
+ *
+ * A byte projection keeps ranges of the bytes of a record, as `cut -b` does. A field projection splits a record at
+ * a delimiter and keeps ranges of the fields, joined by the delimiter, as `cut -f` does; a record without the
+ * delimiter is a single field. The bytes or fields are kept in the order of the record. Ranges are given as a
+ * comma-separated list of positions counting from 1: N, N-M, N- (to the end of the record) or -M (from the start).
+ *
+ * The projection of every record is stored in a payload of a fixed width in the entry of the record (see format.h),
+ * so queries needing only the projection are answered without reading the data file. The projections of records
+ * that do not fit in the payload are computed from the records when they are queried.
+*/
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "index.h"
+
+// Payload width of projections whose size is not bounded by their ranges.
+const uint32_t kDefaultPayloadWidth = 32;
+
+/**
+ * Parse the ranges of a projection. Overlapping and adjacent ranges are merged.
+ * Prints an error if the list is not valid.
+ *
+ * @param list The comma-separated ranges, e.g. "1-8,12".
+ * @param kind The kind of the projection, kByteProjection or kFieldProjection.
+ * @param delimiter The separator of the fields of a field projection.
+ * @param payloadWidth The number of bytes of the projection to store in every entry, at most kMaxPayloadWidth, or
+ *                     0 for the size of the ranges of a byte projection that does not reach the end of the
+ *                     record, and kDefaultPayloadWidth otherwise.
+ * @param projection Receives the projection.
+ * @return bool True if the projection is valid, false otherwise.
+ */
+bool parseProjection(const std::string& list, ProjectionKind kind, char delimiter, uint32_t payloadWidth, Projection& projection);
+
+/**
+ * Compute the projection of a record.
+ *
+ * @param record The record, without its newline.
+ * @param length The length of the record.
+ * @param projection The projection.
+ * @param projected Receives the projection of the record.
+ */
+void projectRecord(const char* record, size_t length, const Projection& projection, std::string& projected);
+
+#endif
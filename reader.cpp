@@ -0,0 +1,1472 @@
+/**
+ * Reading of index files.
+ * See reader.h for an overview.
+*/
+#include "reader.h"
+
+#include "filter.h"
+#include "table.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Size of the blocks read by sequential readers.
+const size_t kCursorBufferSize = 1 << 20;
+// Size of the first read of a cursor over flat, paged, B+tree or front-coded entries. Every read doubles it up to
+// kCursorBufferSize, so a cursor reading few entries, such as one listing a short range, reads little.
+const size_t kFirstCursorRead = 64 * 1024;
+// Size of the buffer of each tree level read by sequential readers of the Eytzinger layout.
+const size_t kLevelBufferSize = 64 * 1024;
+
+/**
+ * Read `length` bytes at a position of a file, retrying short and interrupted reads.
+ */
+bool readFully(int fd, uint64_t position, char* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t count = pread(fd, buffer, length, static_cast<off_t>(position));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        buffer += count;
+        position += static_cast<uint64_t>(count);
+        length -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * Position of the first of `count` packed entries in memory whose key is not less than `key`.
+ */
+uint64_t lowerBoundEntry(const char* entries, uint64_t count, size_t stride, const char* key, size_t keyLength) {
+    uint64_t low = 0;
+    uint64_t high = count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (std::memcmp(entries + mid * stride, key, keyLength) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Compare every byte of a block of the key column of the columnar layout with the same byte of the searched key
+ * repeated over the block, 16 bytes at a time with SSE2 where it is available.
+ *
+ * @param block The block of keys, kKeyBlockSize bytes.
+ * @param pattern The searched key repeated over kKeyBlockSize bytes.
+ * @param equal Receives a mask with bit i set if byte i of the block equals byte i of the pattern.
+ * @param less Receives a mask with bit i set if byte i of the block is less than byte i of the pattern, unsigned.
+ */
+inline void compareKeyBlock(const char* block, const char* pattern, uint64_t& equal, uint64_t& less) {
+    equal = 0;
+    less = 0;
+#if defined(__SSE2__)
+    // Flipping the sign bits turns the signed byte comparison into an unsigned one
+    const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80));
+    for (size_t i = 0; i < kKeyBlockSize; i += 16) {
+        __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        __m128i searched = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + i));
+        uint64_t equalBits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(keys, searched)));
+        uint64_t lessBits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmplt_epi8(_mm_xor_si128(keys, flip), _mm_xor_si128(searched, flip))));
+        equal |= equalBits << i;
+        less |= lessBits << i;
+    }
+#else
+    for (size_t i = 0; i < kKeyBlockSize; ++i) {
+        unsigned char byte = static_cast<unsigned char>(block[i]);
+        unsigned char searched = static_cast<unsigned char>(pattern[i]);
+        equal |= static_cast<uint64_t>(byte == searched) << i;
+        less |= static_cast<uint64_t>(byte < searched) << i;
+    }
+#endif
+}
+
+/**
+ * Number of the leading keys of a block of the key column that are less than the searched key: a key is less if
+ * its first byte that differs from the searched key is less. The keys of a block are sorted, so the count stops
+ * at the first key that is not less.
+ *
+ * @param block The block of keys, kKeyBlockSize bytes holding columnKeysPerBlock(keyLength) keys.
+ * @param pattern The searched key repeated over kKeyBlockSize bytes.
+ * @param keyLength The length of the keys, at most kKeyBlockSize / 2.
+ * @param keyCount The number of keys of the block in use.
+ * @return size_t The number of keys less than the searched key.
+ */
+inline size_t countKeysLess(const char* block, const char* pattern, size_t keyLength, size_t keyCount) {
+    uint64_t equal, less;
+    compareKeyBlock(block, pattern, equal, less);
+    const uint64_t keyBits = (static_cast<uint64_t>(1) << keyLength) - 1;
+    for (size_t i = 0; i < keyCount; ++i) {
+        uint64_t differing = (~equal >> (i * keyLength)) & keyBits;
+        if (differing == 0 || ((less >> (i * keyLength + __builtin_ctzll(differing))) & 1) == 0) {
+            return i;
+        }
+    }
+    return keyCount;
+}
+
+/**
+ * Sequential reader of the entries of an index file through a large buffer.
+ * Entry i is stored at entriesOffset + (i / entriesPerPage) * pageSize + (i % entriesPerPage) * stride, which
+ * covers both the flat layout (one page holding every entry) and the paged layout. The cursor may start at any entry.
+ */
+class IndexCursor : public EntrySource {
+public:
+    IndexCursor(int fd, const IndexHeader& header, uint64_t first = 0)
+        : fd(fd), entriesOffset(header.entriesOffset), count(header.entryCount),
+          stride(storedEntryStride(header)), index(first), started(false), current(nullptr),
+          bufferStart(0), bufferLength(0) {
+        bool paged = header.layout == kPagedLayout;
+        pageSize = paged ? header.pageSize : 0;
+        entriesPerPage = paged ? header.pageSize / stride : std::max<uint64_t>(1, count);
+    }
+
+    ~IndexCursor() {
+        close(fd);
+    }
+
+    const char* head() const { return current; }
+
+    bool next() {
+        index += started ? 1 : 0;
+        started = true;
+        if (index >= count) {
+            return false;
+        }
+
+        uint64_t position = entriesOffset + (index / entriesPerPage) * pageSize + (index % entriesPerPage) * stride;
+        if (position < bufferStart || position + stride > bufferStart + bufferLength) {
+            // Refill from this entry up to the end of the entries
+            uint64_t last = count - 1;
+            uint64_t end = entriesOffset + (last / entriesPerPage) * pageSize + (last % entriesPerPage) * stride + stride;
+            buffer.resize(std::max(stride, std::min(kCursorBufferSize, std::max(kFirstCursorRead, 2 * buffer.size()))));
+            bufferStart = position;
+            bufferLength = static_cast<size_t>(std::min<uint64_t>(buffer.size(), end - position));
+            if (!readFully(fd, bufferStart, buffer.data(), bufferLength)) {
+                std::cerr << "Error reading index file." << std::endl;
+                bufferLength = 0;
+                return false;
+            }
+        }
+        current = buffer.data() + (position - bufferStart);
+        return true;
+    }
+
+private:
+    int fd;
+    uint64_t entriesOffset;
+    uint64_t count;
+    size_t stride;
+    uint64_t pageSize;
+    uint64_t entriesPerPage;
+    uint64_t index;
+    bool started;
+    const char* current;
+    uint64_t bufferStart;
+    size_t bufferLength;
+    std::vector<char> buffer;
+};
+
+/**
+ * Sequential reader of the entries of a B+tree index, following the chain of leaves from the first leaf, or from
+ * any leaf. Leaves that follow each other in the file are read together through a large buffer.
+ */
+class LeafCursor : public EntrySource {
+public:
+    LeafCursor(int fd, const IndexHeader& header, uint64_t firstLeaf = 0)
+        : fd(fd), entriesOffset(header.entriesOffset), nodeSize(header.pageSize),
+          stride(storedEntryStride(header)), leaf(header.pageCount > 0 ? firstLeaf : kNoNode), leafNode(nullptr),
+          itemCount(0), item(0), started(false), bufferStart(0), bufferLength(0),
+          leafCount(header.pageCount) {
+    }
+
+    ~LeafCursor() {
+        close(fd);
+    }
+
+    const char* head() const { return leafNode + kNodeHeaderSize + item * stride; }
+
+    bool next() {
+        item += started ? 1 : 0;
+        if (started && item < itemCount) {
+            return true;
+        }
+        if (started && leafNode != nullptr) {
+            leaf = loadLittleEndian(leafNode + 8, 8);
+        }
+        started = true;
+
+        // Move to the next leaf holding entries
+        for (; leaf != kNoNode; leaf = loadLittleEndian(leafNode + 8, 8)) {
+            if (!loadLeaf()) {
+                return false;
+            }
+            item = 0;
+            itemCount = static_cast<size_t>(loadLittleEndian(leafNode + 4, 4));
+            if (itemCount > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    bool loadLeaf() {
+        uint64_t position = entriesOffset + leaf * nodeSize;
+        if (position < bufferStart || position + nodeSize > bufferStart + bufferLength) {
+            // Read ahead over the leaves stored after this one
+            uint64_t end = entriesOffset + leafCount * nodeSize;
+            buffer.resize(std::max(nodeSize, std::min(kCursorBufferSize, std::max(kFirstCursorRead, 2 * buffer.size()))));
+            bufferStart = position;
+            bufferLength = static_cast<size_t>(std::min<uint64_t>(buffer.size(), std::max<uint64_t>(end, position + nodeSize) - position));
+            if (!readFully(fd, bufferStart, buffer.data(), bufferLength)) {
+                std::cerr << "Error reading index file." << std::endl;
+                bufferLength = 0;
+                return false;
+            }
+        }
+        leafNode = buffer.data() + (position - bufferStart);
+        return true;
+    }
+
+    int fd;
+    uint64_t entriesOffset;
+    size_t nodeSize;
+    size_t stride;
+    uint64_t leaf;
+    const char* leafNode;
+    size_t itemCount;
+    size_t item;
+    bool started;
+    uint64_t bufferStart;
+    size_t bufferLength;
+    std::vector<char> buffer;
+    uint64_t leafCount;
+};
+
+/**
+ * Decode one front-coded entry of `stride` bytes into `entry`, which holds the entry before it.
+ * Returns the position after the entry, or nullptr if the entry does not end before `end` or shares more bytes
+ * than an entry has, which only a corrupt index holds.
+ */
+inline const char* decodeFrontCoded(const char* encoded, const char* end, char* entry, size_t stride) {
+    uint64_t shared;
+    size_t length = loadVarint(encoded, end, shared);
+    if (length == 0 || shared > stride || static_cast<size_t>(end - encoded) - length < stride - shared) {
+        return nullptr;
+    }
+    encoded += length;
+    size_t suffixLength = stride - static_cast<size_t>(shared);
+    std::memcpy(entry + shared, encoded, suffixLength);
+    return encoded + suffixLength;
+}
+
+/**
+ * Sequential decoder of the entries of a front-coded index from the start of a block, reading the blocks through a
+ * large buffer.
+ */
+class FrontCodedCursor : public EntrySource {
+public:
+    FrontCodedCursor(int fd, const IndexHeader& header, uint64_t blockStart, uint64_t firstEntry)
+        : fd(fd), position(blockStart), end(header.fenceOffset),
+          remaining(header.entryCount - firstEntry), entry(storedEntryStride(header)),
+          cursor(buffer.data()), bufferEnd(buffer.data()) {
+    }
+
+    ~FrontCodedCursor() {
+        close(fd);
+    }
+
+    const char* head() const { return entry.data(); }
+
+    bool next() {
+        if (remaining == 0) {
+            return false;
+        }
+        // Keep at least one whole encoded entry in the buffer
+        size_t maxEncoded = 10 + entry.size();
+        if (static_cast<size_t>(bufferEnd - cursor) < maxEncoded && position < end) {
+            size_t kept = static_cast<size_t>(bufferEnd - cursor);
+            size_t keptStart = static_cast<size_t>(cursor - buffer.data());
+            buffer.resize(std::min(kCursorBufferSize, std::max(kFirstCursorRead, 2 * buffer.size())));
+            std::memmove(buffer.data(), buffer.data() + keptStart, kept);
+            size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size() - kept, end - position));
+            if (!readFully(fd, position, buffer.data() + kept, length)) {
+                std::cerr << "Error reading index file." << std::endl;
+                remaining = 0;
+                return false;
+            }
+            position += length;
+            cursor = buffer.data();
+            bufferEnd = buffer.data() + kept + length;
+        }
+        cursor = decodeFrontCoded(cursor, bufferEnd, entry.data(), entry.size());
+        if (cursor == nullptr) {
+            std::cerr << "Error: corrupt index file. Recreate the index with -c." << std::endl;
+            remaining = 0;
+            return false;
+        }
+        --remaining;
+        return true;
+    }
+
+private:
+    int fd;
+    uint64_t position;  // File offset of the bytes after the buffer
+    uint64_t end;
+    uint64_t remaining;
+    std::vector<char> entry;
+    std::vector<char> buffer;
+    const char* cursor;
+    const char* bufferEnd;
+};
+
+/**
+ * Sequential reader of the entries of an Eytzinger index in key order, from the smallest entry or from the entry at
+ * a given position of the tree. The in-order walk reads each level of the tree in increasing position order, so
+ * every level is read sequentially through its own buffer.
+ */
+class EytzingerCursor : public EntrySource {
+public:
+    EytzingerCursor(int fd, const IndexHeader& header, uint64_t first = 0)
+        : fd(fd), entriesOffset(header.entriesOffset), count(header.entryCount),
+          stride(storedEntryStride(header)), position(first), started(false), current(nullptr),
+          levelCapacity(std::max<size_t>(1, kLevelBufferSize / stride)) {
+        for (uint64_t levelStart = 1; levelStart <= count; levelStart *= 2) {
+            levels.push_back(Level());
+            levels.back().start = 0;
+            levels.back().length = 0;
+        }
+    }
+
+    ~EytzingerCursor() {
+        close(fd);
+    }
+
+    const char* head() const { return current; }
+
+    bool next() {
+        if (started) {
+            position = nextEytzingerPosition(position, count);
+        } else if (position == 0) {
+            position = firstEytzingerPosition(count);
+        }
+        started = true;
+        if (position == 0) {
+            return false;
+        }
+
+        unsigned depth = 63 - __builtin_clzll(position);
+        Level& level = levels[depth];
+        if (position < level.start || position >= level.start + level.length) {
+            // Refill up to the end of the level
+            uint64_t levelEnd = std::min<uint64_t>((static_cast<uint64_t>(2) << depth) - 1, count);
+            level.start = position;
+            level.length = std::min<uint64_t>(levelCapacity, levelEnd - position + 1);
+            level.buffer.resize(static_cast<size_t>(level.length) * stride);
+            if (!readFully(fd, entriesOffset + (position - 1) * stride, level.buffer.data(), level.buffer.size())) {
+                std::cerr << "Error reading index file." << std::endl;
+                level.length = 0;
+                return false;
+            }
+        }
+        current = level.buffer.data() + (position - level.start) * stride;
+        return true;
+    }
+
+private:
+    struct Level {
+        uint64_t start;   // Position of the first buffered entry
+        uint64_t length;  // Number of buffered entries
+        std::vector<char> buffer;
+    };
+
+    int fd;
+    uint64_t entriesOffset;
+    uint64_t count;
+    size_t stride;
+    uint64_t position;
+    bool started;
+    const char* current;
+    size_t levelCapacity;
+    std::vector<Level> levels;
+};
+
+/**
+ * Sequential reader of the entries of a columnar index. The key and value columns are each read in order through
+ * their own buffer, and every entry is put together from its key and its value. A reader that does not need the
+ * keys reads only the value column and leaves the keys zeroed. The cursor may start at any entry.
+ */
+class ColumnarCursor : public EntrySource {
+public:
+    ColumnarCursor(int fd, const IndexHeader& header, bool withKeys, uint64_t first = 0)
+        : fd(fd), keyLength(header.keyLength), valuePosition(storedOffsetPosition(header)), valueStride(storedValueStride(header)),
+          keysPerBlock(columnKeysPerBlock(header.keyLength)), blockSize(columnBlockSize(header.keyLength)),
+          keysOffset(header.entriesOffset), valuesOffset(header.fenceOffset), count(header.entryCount), withKeys(withKeys),
+          index(first), started(false), entry(storedEntryStride(header), 0), keysStart(0), keysLength(0), valuesStart(0), valuesLength(0),
+          bufferBlocks(std::max<size_t>(1, kCursorBufferSize / blockSize)), bufferValues(std::max<size_t>(1, kCursorBufferSize / valueStride)),
+          keys(withKeys ? bufferBlocks * blockSize : 0), values(bufferValues * valueStride) {
+    }
+
+    ~ColumnarCursor() {
+        close(fd);
+    }
+
+    const char* head() const { return entry.data(); }
+
+    bool next() {
+        index += started ? 1 : 0;
+        started = true;
+        if (index >= count) {
+            return false;
+        }
+
+        if (withKeys) {
+            uint64_t block = index / keysPerBlock;
+            if (block < keysStart || block >= keysStart + keysLength) {
+                // Refill from this block of keys
+                keysStart = block;
+                keysLength = std::min<uint64_t>(bufferBlocks, (count + keysPerBlock - 1) / keysPerBlock - block);
+                if (!readFully(fd, keysOffset + block * blockSize, keys.data(), static_cast<size_t>(keysLength * blockSize))) {
+                    std::cerr << "Error reading index file." << std::endl;
+                    count = 0;
+                    return false;
+                }
+            }
+            std::memcpy(entry.data(), &keys[static_cast<size_t>((block - keysStart) * blockSize + index % keysPerBlock * keyLength)], keyLength);
+        }
+        if (index < valuesStart || index >= valuesStart + valuesLength) {
+            valuesStart = index;
+            valuesLength = std::min<uint64_t>(bufferValues, count - index);
+            if (!readFully(fd, valuesOffset + index * valueStride, values.data(), static_cast<size_t>(valuesLength * valueStride))) {
+                std::cerr << "Error reading index file." << std::endl;
+                count = 0;
+                return false;
+            }
+        }
+        std::memcpy(entry.data() + valuePosition, &values[static_cast<size_t>((index - valuesStart) * valueStride)], valueStride);
+        return true;
+    }
+
+private:
+    int fd;
+    size_t keyLength;
+    size_t valuePosition;  // Position of the value within an entry
+    size_t valueStride;
+    size_t keysPerBlock;
+    size_t blockSize;
+    uint64_t keysOffset;
+    uint64_t valuesOffset;
+    uint64_t count;
+    bool withKeys;
+    uint64_t index;
+    bool started;
+    std::vector<char> entry;
+    uint64_t keysStart;     // First buffered block of keys
+    uint64_t keysLength;    // Number of buffered blocks of keys
+    uint64_t valuesStart;   // Position of the first buffered value
+    uint64_t valuesLength;  // Number of buffered values
+    size_t bufferBlocks;  // Blocks of keys the key buffer holds
+    size_t bufferValues;  // Values the value buffer holds
+    std::vector<char> keys;
+    std::vector<char> values;
+};
+
+/**
+ * Sequential reader of the entries of a table index: the slots are read in order through a large buffer, and after
+ * the entry of every full slot come the further entries of its key, read from the overflow area.
+ */
+class TableCursor : public EntrySource {
+public:
+    TableCursor(int fd, const IndexHeader& header)
+        : fd(fd), entriesOffset(header.entriesOffset), tableOffset(header.fenceOffset), slotCount(header.pageCount),
+          stride(storedEntryStride(header)), entryPosition(slotEntryPosition(header)), slotSize(tableSlotSize(header)),
+          overflowWidth(header.overflowWidth),
+          slot(0), started(false), current(nullptr), runPosition(0), runRemaining(0),
+          slots(std::max<size_t>(1, kCursorBufferSize / slotSize) * slotSize), slotsStart(0), slotsLength(0),
+          run(std::max<size_t>(1, kCursorBufferSize / stride) * stride), runBuffered(0), runNext(0) {
+    }
+
+    ~TableCursor() {
+        close(fd);
+    }
+
+    const char* head() const { return current; }
+
+    bool next() {
+        if (runRemaining > 0) {
+            return nextInRun();
+        }
+        for (slot += started ? 1 : 0, started = true; slot < slotCount; ++slot) {
+            const char* stored = loadSlot(slot);
+            if (stored == nullptr) {
+                return false;
+            }
+            if (loadLittleEndian(stored, kFingerprintSize) != 0) {
+                uint64_t runStart = loadLittleEndian(stored + entryPosition + stride, overflowWidth);
+                runRemaining = loadLittleEndian(stored + entryPosition + stride + overflowWidth, overflowWidth);
+                runPosition = runStart > 0 ? runStart - 1 : 0;
+                runBuffered = 0;
+                runNext = 0;
+                current = stored + entryPosition;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const char* loadSlot(uint64_t number) {
+        uint64_t position = tableOffset + number * slotSize;
+        if (position < slotsStart || position + slotSize > slotsStart + slotsLength) {
+            slotsStart = position;
+            slotsLength = static_cast<size_t>(std::min<uint64_t>(slots.size(), (slotCount - number) * slotSize));
+            if (!readFully(fd, slotsStart, slots.data(), slotsLength)) {
+                std::cerr << "Error reading index file." << std::endl;
+                slotsLength = 0;
+                return nullptr;
+            }
+        }
+        return slots.data() + (position - slotsStart);
+    }
+
+    bool nextInRun() {
+        if (runNext == runBuffered) {
+            runBuffered = static_cast<size_t>(std::min<uint64_t>(run.size() / stride, runRemaining));
+            if (!readFully(fd, entriesOffset + runPosition * stride, run.data(), runBuffered * stride)) {
+                std::cerr << "Error reading index file." << std::endl;
+                runRemaining = 0;
+                return false;
+            }
+            runPosition += runBuffered;
+            runNext = 0;
+        }
+        current = run.data() + runNext * stride;
+        ++runNext;
+        --runRemaining;
+        return true;
+    }
+
+    int fd;
+    uint64_t entriesOffset;
+    uint64_t tableOffset;
+    uint64_t slotCount;
+    size_t stride;
+    size_t entryPosition;
+    size_t slotSize;
+    size_t overflowWidth;
+    uint64_t slot;
+    bool started;
+    const char* current;
+    uint64_t runPosition;  // Position in the overflow area of the next entry of the run to read
+    uint64_t runRemaining;  // Entries of the run not passed on yet
+    std::vector<char> slots;
+    uint64_t slotsStart;
+    size_t slotsLength;
+    std::vector<char> run;
+    size_t runBuffered;  // Entries of the run in the buffer
+    size_t runNext;  // Next of them
+};
+
+/**
+ * Source converting the entries of a cursor from their layout in the index file to their layout in memory, the
+ * layout sorters merge.
+ */
+class DecodingSource : public EntrySource {
+public:
+    DecodingSource(EntrySource* stored, const IndexHeader& header)
+        : stored(stored), header(header), entry(entryStride(header.keyLength)) {
+    }
+
+    const char* head() const { return entry.data(); }
+
+    bool next() {
+        if (!stored->next()) {
+            return false;
+        }
+        decodeIndexEntry(stored->head(), entry.data(), header);
+        return true;
+    }
+
+private:
+    std::unique_ptr<EntrySource> stored;
+    IndexHeader header;
+    std::vector<char> entry;
+};
+
+/**
+ * Source of the entries of another source from the first whose key is not less than a key, for sources that start
+ * at most a block or a leaf before it.
+ */
+class SkippingSource : public EntrySource {
+public:
+    SkippingSource(EntrySource* source, const std::string& key) : source(source), key(key), skipped(false) {
+    }
+
+    const char* head() const { return source->head(); }
+
+    bool next() {
+        if (skipped) {
+            return source->next();
+        }
+        skipped = true;
+        while (source->next()) {
+            if (std::memcmp(source->head(), key.data(), key.size()) >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::unique_ptr<EntrySource> source;
+    std::string key;
+    bool skipped;
+};
+
+} // namespace
+
+IndexReader::IndexReader() : fd(-1), stride(0), mapping(nullptr), mappingLength(0), mappedFile(false), reads(0), foundPosition(0), foundNode(kNoNode) {
+}
+
+IndexReader::~IndexReader() {
+    if (mapping != nullptr) {
+        munmap(const_cast<char*>(mapping), mappingLength);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool IndexReader::open(const std::string& indexFilename, bool mapped) {
+    fd = ::open(indexFilename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error opening index file for reading." << std::endl;
+        return false;
+    }
+
+    std::vector<char> headerBytes(kIndexHeaderSize);
+    ssize_t count = pread(fd, headerBytes.data(), headerBytes.size(), 0);
+    if (!decodeIndexHeader(headerBytes.data(), count > 0 ? static_cast<size_t>(count) : 0, indexHeader)) {
+        return false;
+    }
+    stride = storedEntryStride(indexHeader);
+    candidate.resize(stride);
+
+    // Lookups of a mapped index read it in place, and the layouts that map a section use the same mapping
+    if (mapped) {
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            std::cerr << "Error reading index file." << std::endl;
+            return false;
+        }
+        mappingLength = static_cast<size_t>(status.st_size);
+        void* address = mmap(nullptr, mappingLength, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            std::cerr << "Error mapping index file." << std::endl;
+            return false;
+        }
+        mapping = static_cast<const char*>(address);
+        mappedFile = true;
+        madvise(const_cast<char*>(mapping), mappingLength, MADV_RANDOM);
+    }
+
+    // The fence array of the paged layout stays in memory for lookups
+    if (indexHeader.layout == kPagedLayout) {
+        fences.resize(static_cast<size_t>(indexHeader.pageCount) * stride);
+        page.resize(indexHeader.pageSize);
+        if (!readFully(fd, indexHeader.fenceOffset, fences.data(), fences.size())) {
+            std::cerr << "Error reading index file." << std::endl;
+            return false;
+        }
+    } else if (indexHeader.layout == kFrontCodedLayout) {
+        // The block index stays in memory for lookups
+        fences.resize(static_cast<size_t>(indexHeader.pageCount) * (stride + sizeof(uint64_t)));
+        page.resize(indexHeader.restartInterval * (10 + stride));
+        if (!readFully(fd, indexHeader.fenceOffset, fences.data(), fences.size())) {
+            std::cerr << "Error reading index file." << std::endl;
+            return false;
+        }
+    } else if (indexHeader.layout == kLearnedLayout) {
+        // The model stays in memory for lookups
+        columns.resize(2 * indexHeader.keyColumns);
+        std::vector<char> model(static_cast<size_t>(indexHeader.pageCount) * kSegmentSize);
+        if (!readFully(fd, indexHeader.fenceOffset, reinterpret_cast<char*>(columns.data()), columns.size()) ||
+            !readFully(fd, indexHeader.fenceOffset + columns.size(), model.data(), model.size())) {
+            std::cerr << "Error reading index file." << std::endl;
+            return false;
+        }
+        segments.resize(static_cast<size_t>(indexHeader.pageCount));
+        for (size_t i = 0; i < segments.size(); ++i) {
+            uint64_t slopeBits = loadLittleEndian(&model[i * kSegmentSize + 16], 8);
+            segments[i].key = loadLittleEndian(&model[i * kSegmentSize], 8);
+            segments[i].position = loadLittleEndian(&model[i * kSegmentSize + 8], 8);
+            std::memcpy(&segments[i].slope, &slopeBits, sizeof(slopeBits));
+        }
+    } else if (indexHeader.layout == kHashLayout) {
+        // Lookups probe the bit arrays of the hash function in place, so it is mapped rather than read
+        std::vector<char> levels(static_cast<size_t>(indexHeader.pageCount) * 8);
+        if (!readFully(fd, indexHeader.fenceOffset, levels.data(), levels.size())) {
+            std::cerr << "Error reading index file." << std::endl;
+            return false;
+        }
+        uint64_t wordCount = 0;
+        for (size_t level = 0; level < indexHeader.pageCount; ++level) {
+            wordCount += loadLittleEndian(&levels[level * 8], 8) / 64;
+        }
+        uint64_t sectionEnd = indexHeader.fenceOffset + PerfectHash::storedSize(static_cast<uint32_t>(indexHeader.pageCount), wordCount);
+        uint64_t systemPageSize = static_cast<uint64_t>(sysconf(_SC_PAGE_SIZE));
+        uint64_t mapStart = mappedFile ? 0 : indexHeader.fenceOffset / systemPageSize * systemPageSize;
+        if (mappedFile ? sectionEnd > mappingLength : !mapSection(mapStart, sectionEnd - mapStart)) {
+            std::cerr << "Error mapping index file." << std::endl;
+            return false;
+        }
+        if (!function.open(mapping + (indexHeader.fenceOffset - mapStart), static_cast<size_t>(sectionEnd - indexHeader.fenceOffset),
+                           static_cast<uint32_t>(indexHeader.pageCount)) || function.placedCount() > indexHeader.entryCount) {
+            std::cerr << "Error: corrupt index file. Recreate the index with -c." << std::endl;
+            return false;
+        }
+        page.resize(static_cast<size_t>(indexHeader.entryCount - function.placedCount()) * stride + stride);
+    } else if (indexHeader.layout == kTableLayout) {
+        // Lookups probe the slots in place
+        if (!mappedFile && !mapSection(0, indexHeader.fenceOffset + indexHeader.pageCount * tableSlotSize(indexHeader))) {
+            std::cerr << "Error mapping index file." << std::endl;
+            return false;
+        }
+    } else if (indexHeader.layout == kEytzingerLayout || indexHeader.layout == kColumnarLayout) {
+        // Lookups jump through the tree or the key column in memory, so the entries are mapped rather than read
+        uint64_t sectionEnd;
+        if (indexHeader.layout == kEytzingerLayout) {
+            sectionEnd = indexHeader.entriesOffset + indexHeader.entryCount * stride;
+        } else {
+            sectionEnd = indexHeader.fenceOffset + indexHeader.entryCount * storedValueStride(indexHeader);
+            page.resize(kKeyBlockSize);  // The searched key repeated over a block of keys
+        }
+        if (!mappedFile && indexHeader.entryCount > 0 && !mapSection(0, sectionEnd)) {
+            std::cerr << "Error mapping index file." << std::endl;
+            return false;
+        }
+    } else if (indexHeader.layout == kBTreeLayout) {
+        // The root stays in memory for lookups
+        page.resize(indexHeader.pageSize);
+        if (indexHeader.rootNode != kNoNode) {
+            root.resize(indexHeader.pageSize);
+            if (!readFully(fd, indexHeader.entriesOffset + indexHeader.rootNode * indexHeader.pageSize, root.data(), root.size())) {
+                std::cerr << "Error reading index file." << std::endl;
+                return false;
+            }
+        }
+    } else {
+        page.resize(2 * stride);
+    }
+    return true;
+}
+
+bool IndexReader::mapSection(uint64_t start, uint64_t length) {
+    void* address = mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_SHARED, fd, static_cast<off_t>(start));
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    mapping = static_cast<const char*>(address);
+    mappingLength = static_cast<size_t>(length);
+    madvise(const_cast<char*>(mapping), mappingLength, MADV_RANDOM);
+    return true;
+}
+
+const char* IndexReader::readAt(uint64_t position, char* buffer, size_t length) {
+    if (mappedFile) {
+        if (position > mappingLength || length > mappingLength - position) {
+            std::cerr << "Error reading index file." << std::endl;
+            return nullptr;
+        }
+        return mapping + position;
+    }
+    ++reads;
+    if (!readFully(fd, position, buffer, length)) {
+        std::cerr << "Error reading index file." << std::endl;
+        return nullptr;
+    }
+    return buffer;
+}
+
+bool IndexReader::find(const std::string& key, std::streamoff& offset, uint32_t& length) {
+    const char* entry = findEntry(key);
+    if (entry == nullptr) {
+        return false;
+    }
+    offset = loadStoredOffset(entry, indexHeader);
+    length = loadStoredRecordLength(entry, indexHeader);
+    return true;
+}
+
+/**
+ * Most absent keys stop at their block of the filter.
+ */
+bool IndexReader::filterMayContain(const std::string& key) {
+    if (indexHeader.filterBlocks == 0) {
+        return true;
+    }
+    uint64_t hash = hashKey(key.data(), key.size());
+    char buffer[kFilterBlockSize];
+    const char* block = readAt(indexHeader.filterOffset + filterBlock(hash, indexHeader.filterBlocks) * kFilterBlockSize, buffer, sizeof(buffer));
+    return block != nullptr && filterBlockContains(block, hash, indexHeader.filterHashes);
+}
+
+const char* IndexReader::findEntry(const std::string& key) {
+    if (key.size() != indexHeader.keyLength || !filterMayContain(key)) {
+        return nullptr;
+    }
+
+    const char* entry = findLowerBound(key.data());
+    if (entry == nullptr || std::memcmp(entry, key.data(), key.size()) != 0) {
+        return nullptr;
+    }
+    return entry;
+}
+
+bool IndexReader::findAll(const std::string& key, std::vector<char>& entries) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t count = indexHeader.entryCount;
+    entries.clear();
+    if (key.size() != keyLength || !filterMayContain(key)) {
+        return true;
+    }
+
+    const char* first = findLowerBound(key.data());
+    if (first == nullptr || std::memcmp(first, key.data(), keyLength) != 0) {
+        return true;
+    }
+
+    if (indexHeader.layout == kFrontCodedLayout) {
+        // Decode again from the start of the block the lookup decoded, on through the blocks after it that hold
+        // the key
+        for (uint64_t block = foundNode; block < indexHeader.pageCount; ++block) {
+            const char* blockEnd;
+            const char* encoded = readFrontCodedBlock(block, blockEnd);
+            if (encoded == nullptr) {
+                return false;
+            }
+            while (encoded < blockEnd) {
+                encoded = decodeFrontCoded(encoded, blockEnd, candidate.data(), stride);
+                if (encoded == nullptr) {
+                    std::cerr << "Error: corrupt index file. Recreate the index with -c." << std::endl;
+                    return false;
+                }
+                int order = std::memcmp(candidate.data(), key.data(), keyLength);
+                if (order > 0) {
+                    return true;
+                }
+                if (order == 0) {
+                    entries.insert(entries.end(), candidate.begin(), candidate.end());
+                }
+            }
+        }
+        return true;
+    }
+
+    entries.assign(first, first + stride);
+    if (indexHeader.layout == kHashLayout) {
+        // The hash layout holds one entry per key
+        return true;
+    }
+    if (indexHeader.layout == kTableLayout) {
+        // The further entries of the key are together in the overflow area, which is in the mapping
+        uint64_t runStart = loadLittleEndian(first + stride, indexHeader.overflowWidth);
+        uint64_t runLength = loadLittleEndian(first + stride + indexHeader.overflowWidth, indexHeader.overflowWidth);
+        if (runStart > 0) {
+            const char* run = mapping + indexHeader.entriesOffset + (runStart - 1) * stride;
+            entries.insert(entries.end(), run, run + runLength * stride);
+        }
+        return true;
+    }
+    if (indexHeader.layout == kEytzingerLayout) {
+        // The further entries of the key are the in-order successors of the first, in the mapping
+        const char* stored = mapping + indexHeader.entriesOffset - stride;  // Entry k at stored + k * stride
+        uint64_t position = static_cast<uint64_t>(first - stored) / stride;
+        while ((position = nextEytzingerPosition(position, count)) != 0) {
+            const char* entry = stored + position * stride;
+            if (std::memcmp(entry, key.data(), keyLength) != 0) {
+                break;
+            }
+            entries.insert(entries.end(), entry, entry + stride);
+        }
+        return true;
+    }
+    if (indexHeader.layout == kBTreeLayout) {
+        // The further entries of the key follow the first in its leaf, and on in the leaves after it
+        uint64_t item = foundPosition + 1;
+        for (uint64_t leaf = foundNode; leaf != kNoNode; item = 0) {
+            const char* node = readAt(indexHeader.entriesOffset + leaf * indexHeader.pageSize, page.data(), page.size());
+            if (node == nullptr) {
+                return false;
+            }
+            uint64_t items = loadLittleEndian(node + 4, 4);
+            for (; item < items; ++item) {
+                const char* entry = node + kNodeHeaderSize + item * stride;
+                if (std::memcmp(entry, key.data(), keyLength) != 0) {
+                    return true;
+                }
+                entries.insert(entries.end(), entry, entry + stride);
+            }
+            leaf = loadLittleEndian(node + 8, 8);
+        }
+        return true;
+    }
+
+    // The flat, paged, learned and columnar layouts: the further entries of the key are at the positions after the
+    // first
+    for (uint64_t position = foundPosition + 1; position < count; ++position) {
+        const char* entry = entryAt(position);
+        if (entry == nullptr) {
+            return false;
+        }
+        if (std::memcmp(entry, key.data(), keyLength) != 0) {
+            break;
+        }
+        entries.insert(entries.end(), entry, entry + stride);
+    }
+    return true;
+}
+
+const char* IndexReader::findLowerBound(const char* key) {
+    if (indexHeader.layout == kPagedLayout) {
+        return findPaged(key);
+    } else if (indexHeader.layout == kBTreeLayout) {
+        return findBTree(key);
+    } else if (indexHeader.layout == kFrontCodedLayout) {
+        return findFrontCoded(key);
+    } else if (indexHeader.layout == kEytzingerLayout) {
+        return findEytzinger(key);
+    } else if (indexHeader.layout == kLearnedLayout) {
+        return findLearned(key);
+    } else if (indexHeader.layout == kHashLayout) {
+        return findHashed(key);
+    } else if (indexHeader.layout == kTableLayout) {
+        return findInTable(key);
+    } else if (indexHeader.layout == kColumnarLayout) {
+        return findColumnar(key);
+    }
+    return findFlat(key);
+}
+
+bool IndexReader::findSorted(const std::vector<std::string>& keys, std::vector<char>& entries, std::vector<uint64_t>& runs) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t count = indexHeader.entryCount;
+    const bool positional = indexHeader.layout == kFlatLayout || indexHeader.layout == kPagedLayout ||
+        indexHeader.layout == kLearnedLayout || indexHeader.layout == kColumnarLayout;
+    entries.clear();
+    runs.assign(1, 0);
+
+    std::vector<char> run;
+    uint64_t position = 0;  // First entry not less than the previous key
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const std::string& key = keys[i];
+        if (!positional) {
+            if (!findAll(key, run)) {
+                return false;
+            }
+            entries.insert(entries.end(), run.begin(), run.end());
+            runs.push_back(entries.size() / stride);
+            continue;
+        }
+        if (key.size() != keyLength || !filterMayContain(key)) {
+            runs.push_back(entries.size() / stride);
+            continue;
+        }
+
+        // Gallop from the previous position: probe 1, 2, 4, ... entries ahead until an entry is not less than the
+        // key, then binary search the last step
+        uint64_t low = position;
+        uint64_t high = position;
+        for (uint64_t step = 1; high < count; step *= 2) {
+            const char* entry = entryAt(high);
+            if (entry == nullptr) {
+                return false;
+            }
+            if (std::memcmp(entry, key.data(), keyLength) >= 0) {
+                break;
+            }
+            low = high + 1;
+            high = std::min(count, low + step);
+        }
+        while (low < high) {
+            uint64_t mid = low + (high - low) / 2;
+            const char* entry = entryAt(mid);
+            if (entry == nullptr) {
+                return false;
+            }
+            if (std::memcmp(entry, key.data(), keyLength) < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        position = low;
+
+        // The entries of the key follow the first of them
+        for (uint64_t next = position; next < count; ++next) {
+            const char* entry = entryAt(next);
+            if (entry == nullptr) {
+                return false;
+            }
+            if (std::memcmp(entry, key.data(), keyLength) != 0) {
+                break;
+            }
+            entries.insert(entries.end(), entry, entry + stride);
+        }
+        runs.push_back(entries.size() / stride);
+    }
+    return true;
+}
+
+/**
+ * The entry at a position in the sorted order of the flat, paged, learned and columnar layouts.
+ */
+const char* IndexReader::entryAt(uint64_t position) {
+    if (indexHeader.layout == kColumnarLayout) {
+        const size_t keyLength = indexHeader.keyLength;
+        const size_t keysPerBlock = columnKeysPerBlock(keyLength);
+        const size_t valueStride = storedValueStride(indexHeader);
+        const char* keys = mapping + indexHeader.entriesOffset;
+        std::memcpy(candidate.data(), keys + position / keysPerBlock * columnBlockSize(keyLength) + position % keysPerBlock * keyLength, keyLength);
+        std::memcpy(candidate.data() + storedOffsetPosition(indexHeader), mapping + indexHeader.fenceOffset + position * valueStride, valueStride);
+        return candidate.data();
+    }
+    uint64_t location = indexHeader.entriesOffset + position * stride;
+    if (indexHeader.layout == kPagedLayout) {
+        const uint64_t entriesPerPage = indexHeader.pageSize / stride;
+        location = indexHeader.entriesOffset + position / entriesPerPage * indexHeader.pageSize + position % entriesPerPage * stride;
+    }
+    return readAt(location, candidate.data(), stride);
+}
+
+/**
+ * Binary search for the first entry with the key, reading the entry at every probe, or comparing it in place in
+ * a mapped index.
+ */
+const char* IndexReader::findFlat(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const char* candidate = nullptr;  // Smallest entry seen so far that is not less than the key
+    uint64_t low = 0;
+    uint64_t high = indexHeader.entryCount;
+
+    while (low < high) {  // Loop until the search range is narrowed down
+        uint64_t mid = low + (high - low) / 2;  // Calculate the middle index to avoid overflow
+        // Read into the half of the buffer that does not hold the candidate
+        const char* probe = readAt(indexHeader.entriesOffset + mid * stride, candidate == page.data() ? page.data() + stride : page.data(), stride);
+        if (probe == nullptr) {
+            return nullptr;
+        }
+        if (std::memcmp(probe, key, keyLength) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+            candidate = probe;
+        }
+    }
+
+    foundPosition = low;
+    return candidate;
+}
+
+/**
+ * Search the fences for the page that holds the first entry with the key, then search that page.
+ */
+const char* IndexReader::findPaged(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t entriesPerPage = indexHeader.pageSize / stride;
+
+    if (indexHeader.pageCount == 0) {
+        return nullptr;
+    }
+
+    // First page whose first entry is not less than the key
+    uint64_t fence = lowerBoundEntry(fences.data(), indexHeader.pageCount, stride, key, keyLength);
+
+    // The first entry with the key is in the page before, or is the first entry of that page
+    uint64_t pageIndex = fence > 0 ? fence - 1 : 0;
+    uint64_t pageEntries = std::min(entriesPerPage, indexHeader.entryCount - pageIndex * entriesPerPage);
+    const char* entries = readAt(indexHeader.entriesOffset + pageIndex * indexHeader.pageSize, page.data(), static_cast<size_t>(pageEntries * stride));
+    if (entries == nullptr) {
+        return nullptr;
+    }
+    uint64_t position = lowerBoundEntry(entries, pageEntries, stride, key, keyLength);
+    const char* entry = entries + position * stride;
+    if (position == pageEntries) {
+        foundPosition = fence * entriesPerPage;
+        return fence < indexHeader.pageCount ? fences.data() + fence * stride : nullptr;
+    }
+    foundPosition = pageIndex * entriesPerPage + position;
+    return entry;
+}
+
+/**
+ * Walk from the root to the leaf that can hold the first entry with the key, in the same way as the paged layout:
+ * at every inner node, descend into the child before the first item not less than the key, and remember that
+ * item in case the entry turns out to be the first entry of the next subtree.
+ */
+const char* IndexReader::findBTree(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const size_t itemSize = stride + sizeof(uint64_t);
+    if (indexHeader.rootNode == kNoNode) {
+        return nullptr;
+    }
+
+    const char* node = root.data();
+    uint64_t leaf = indexHeader.rootNode;
+    bool candidateFound = false;
+    while (loadLittleEndian(node, 4) > 0) {
+        uint64_t items = loadLittleEndian(node + 4, 4);
+        uint64_t position = lowerBoundEntry(node + kNodeHeaderSize, items, itemSize, key, keyLength);
+        if (position < items) {
+            std::memcpy(candidate.data(), node + kNodeHeaderSize + position * itemSize, stride);
+            candidateFound = true;
+        }
+        leaf = loadLittleEndian(node + kNodeHeaderSize + (position > 0 ? position - 1 : 0) * itemSize + stride, 8);
+        node = readAt(indexHeader.entriesOffset + leaf * indexHeader.pageSize, page.data(), page.size());
+        if (node == nullptr) {
+            return nullptr;
+        }
+    }
+
+    uint64_t items = loadLittleEndian(node + 4, 4);
+    uint64_t position = lowerBoundEntry(node + kNodeHeaderSize, items, stride, key, keyLength);
+    const char* entry = node + kNodeHeaderSize + position * stride;
+    if (position == items) {
+        // The candidate starts the next leaf
+        foundNode = loadLittleEndian(node + 8, 8);
+        foundPosition = 0;
+        return candidateFound ? candidate.data() : nullptr;
+    }
+    foundNode = leaf;
+    foundPosition = position;
+    return entry;
+}
+
+/**
+ * Read a block of the front-coded layout, whose bounds are in the block index.
+ */
+const char* IndexReader::readFrontCodedBlock(uint64_t block, const char*& blockEnd) {
+    const size_t itemSize = stride + sizeof(uint64_t);
+    uint64_t start = loadLittleEndian(&fences[block * itemSize + stride], 8);
+    uint64_t end = block + 1 < indexHeader.pageCount ? loadLittleEndian(&fences[(block + 1) * itemSize + stride], 8) : indexHeader.fenceOffset;
+    if (start < indexHeader.entriesOffset || end < start || end - start > page.size()) {
+        std::cerr << "Error: corrupt index file. Recreate the index with -c." << std::endl;
+        return nullptr;
+    }
+    const char* blockData = readAt(start, page.data(), static_cast<size_t>(end - start));
+    if (blockData != nullptr) {
+        blockEnd = blockData + (end - start);
+    }
+    return blockData;
+}
+
+/**
+ * Search the block index for the block that holds the first entry with the key, then decode that block.
+ */
+const char* IndexReader::findFrontCoded(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const size_t itemSize = stride + sizeof(uint64_t);
+    if (indexHeader.pageCount == 0) {
+        return nullptr;
+    }
+
+    // First block whose first entry is not less than the key; the entry is in the block before, or starts this one
+    uint64_t block = lowerBoundEntry(fences.data(), indexHeader.pageCount, itemSize, key, keyLength);
+    uint64_t blockIndex = block > 0 ? block - 1 : 0;
+    const char* blockEnd;
+    const char* encoded = readFrontCodedBlock(blockIndex, blockEnd);
+    if (encoded == nullptr) {
+        return nullptr;
+    }
+
+    while (encoded < blockEnd) {
+        encoded = decodeFrontCoded(encoded, blockEnd, candidate.data(), stride);
+        if (encoded == nullptr) {
+            std::cerr << "Error: corrupt index file. Recreate the index with -c." << std::endl;
+            return nullptr;
+        }
+        if (std::memcmp(candidate.data(), key, keyLength) >= 0) {
+            foundNode = blockIndex;
+            return candidate.data();
+        }
+    }
+    foundNode = block;
+    return block < indexHeader.pageCount ? &fences[block * itemSize] : nullptr;
+}
+
+/**
+ * Descend the implicit tree without branching on the comparisons: at position k go to 2k, plus one if the entry
+ * is less than the key. The 16 descendants four levels below are prefetched while the current level is compared,
+ * since they are next to each other in the file. The path ends below a leaf, and the first entry not less than
+ * the key is the last ancestor reached by going left: shifting out the trailing ones and one zero gives it.
+ */
+const char* IndexReader::findEytzinger(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t count = indexHeader.entryCount;
+    const char* entries = mapping + indexHeader.entriesOffset - stride;  // Entry k at entries + k * stride
+
+    uint64_t position = 1;
+    while (position <= count) {
+        uint64_t descendants = 16 * position;
+        if (descendants <= count) {
+            __builtin_prefetch(entries + descendants * stride);
+        }
+        position = 2 * position + (std::memcmp(entries + position * stride, key, keyLength) < 0);
+    }
+    position >>= __builtin_ffsll(static_cast<long long>(~position));
+
+    return position > 0 ? entries + position * stride : nullptr;
+}
+
+/**
+ * Binary search the first keys of the blocks of the key column for the last block whose first key is less than
+ * the key, prefetching the first keys of both possible next probes, then compare the key with every key of that
+ * block at once (see countKeysLess). The first key not less than the key is in that block or starts the next one.
+ * The entry is put together from its key and its value.
+ */
+const char* IndexReader::findColumnar(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t count = indexHeader.entryCount;
+    const size_t keysPerBlock = columnKeysPerBlock(keyLength);
+    const size_t blockSize = columnBlockSize(keyLength);
+    const char* keys = mapping + indexHeader.entriesOffset;
+    if (count == 0) {
+        return nullptr;
+    }
+
+    uint64_t base = 0;
+    uint64_t length = (count + keysPerBlock - 1) / keysPerBlock;
+    while (length > 1) {
+        uint64_t half = length / 2;
+        __builtin_prefetch(keys + (base + half / 2) * blockSize);
+        __builtin_prefetch(keys + (base + half + half / 2) * blockSize);
+        base = std::memcmp(keys + (base + half) * blockSize, key, keyLength) < 0 ? base + half : base;
+        length -= half;
+    }
+
+    uint64_t position = base * keysPerBlock;
+    size_t blockKeys = static_cast<size_t>(std::min<uint64_t>(keysPerBlock, count - position));
+    if (keysPerBlock > 1) {
+        for (size_t i = 0; i + keyLength <= kKeyBlockSize; i += keyLength) {
+            std::memcpy(&page[i], key, keyLength);
+        }
+        position += countKeysLess(keys + base * blockSize, page.data(), keyLength, blockKeys);
+    } else {
+        position += std::memcmp(keys + base * blockSize, key, keyLength) < 0 ? 1 : 0;
+    }
+    foundPosition = position;
+    return position < count ? entryAt(position) : nullptr;
+}
+
+/**
+ * Predict the position of the first entry not less than the key with the segment covering its mapped key, and read
+ * the entries within the error bound around the prediction in one read. The prediction is clamped to the entries
+ * of the segment. If the first entry not less than the key lies outside the window, which only happens among
+ * entries whose mapped keys are equal, the window grows past the side it must be on, doubling each time.
+ */
+const char* IndexReader::findLearned(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t count = indexHeader.entryCount;
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // Last segment starting at or before the mapped key
+    uint64_t value = learnedKeyValue(key, columns.data(), columns.size() / 2);
+    size_t segment = 0;
+    size_t high = segments.size();
+    while (segment + 1 < high) {
+        size_t mid = segment + (high - segment) / 2;
+        if (segments[mid].key <= value) {
+            segment = mid;
+        } else {
+            high = mid;
+        }
+    }
+    const Segment& line = segments[segment];
+    uint64_t segmentEnd = segment + 1 < segments.size() ? segments[segment + 1].position : count;
+    double predicted = static_cast<double>(line.position) + line.slope * static_cast<double>(value > line.key ? value - line.key : 0);
+    uint64_t position = predicted < static_cast<double>(segmentEnd) ? static_cast<uint64_t>(predicted) : segmentEnd;
+
+    // The window has one entry of margin for rounding on each side
+    const uint64_t error = indexHeader.modelError + 1;
+    uint64_t first = position > error ? position - error : 0;
+    uint64_t last = std::min(count, position + error + 1);
+    uint64_t width = last - first;
+    for (;;) {
+        if (!mappedFile) {
+            page.resize(static_cast<size_t>(last - first) * stride);
+        }
+        const char* window = readAt(indexHeader.entriesOffset + first * stride, page.data(), static_cast<size_t>(last - first) * stride);
+        if (window == nullptr) {
+            return nullptr;
+        }
+        uint64_t found = lowerBoundEntry(window, last - first, stride, key, keyLength);
+        if (found == 0 && first > 0) {
+            // Every entry of the window is not less than the key: look before it, keeping its first entry
+            width *= 2;
+            last = first + 1;
+            first = last > width ? last - width : 0;
+        } else if (found == last - first && last < count) {
+            // Every entry of the window is less than the key: look after it, keeping its last entry
+            width *= 2;
+            first = last - 1;
+            last = std::min(count, first + width);
+        } else {
+            foundPosition = first + found;
+            return found < last - first ? window + found * stride : nullptr;
+        }
+    }
+}
+
+/**
+ * Read the entry at the position the hash function gives the key. The entry is that of the key if the key is in
+ * the index, and of another key otherwise. Keys the function left without a position are searched among the
+ * entries after the positions it gives, which are few and read together.
+ */
+const char* IndexReader::findHashed(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    uint64_t position = function.slot(hashKey(key, keyLength));
+    if (position < function.placedCount()) {
+        return readAt(indexHeader.entriesOffset + position * stride, page.data(), stride);
+    }
+
+    uint64_t unplaced = indexHeader.entryCount - function.placedCount();
+    const char* entries = unplaced > 0 ? readAt(indexHeader.entriesOffset + function.placedCount() * stride, page.data(), static_cast<size_t>(unplaced * stride)) : nullptr;
+    if (entries == nullptr) {
+        return nullptr;
+    }
+    uint64_t found = lowerBoundEntry(entries, unplaced, stride, key, keyLength);
+    return found < unplaced ? entries + found * stride : nullptr;
+}
+
+/**
+ * Probe the slots from the one the hash of the key selects, comparing keys only where the fingerprint matches,
+ * until the slot of the key or an empty slot. The slot holds the first entry of the key.
+ */
+const char* IndexReader::findInTable(const char* key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const size_t slotSize = tableSlotSize(indexHeader);
+    const size_t entryPosition = slotEntryPosition(indexHeader);
+    const uint64_t mask = indexHeader.pageCount - 1;
+    const char* table = mapping + indexHeader.fenceOffset;
+    uint64_t hash = hashKey(key, keyLength);
+    uint16_t fingerprint = tableFingerprint(hash);
+
+    for (uint64_t slot = tableHome(hash, indexHeader.pageCount); ; slot = (slot + 1) & mask) {
+        const char* stored = table + slot * slotSize;
+        uint64_t slotFingerprint = loadLittleEndian(stored, kFingerprintSize);
+        if (slotFingerprint == 0) {
+            return nullptr;
+        }
+        if (slotFingerprint == fingerprint && std::memcmp(stored + entryPosition, key, keyLength) == 0) {
+            return stored + entryPosition;
+        }
+    }
+}
+
+std::unique_ptr<EntrySource> IndexReader::entries(bool withKeys) const {
+    std::unique_ptr<EntrySource> stored = storedEntries(withKeys);
+    if (!stored) {
+        return stored;
+    }
+    return std::unique_ptr<EntrySource>(new DecodingSource(stored.release(), indexHeader));
+}
+
+std::unique_ptr<EntrySource> IndexReader::storedEntries(bool withKeys) const {
+    int cursorFd = dup(fd);
+    if (cursorFd < 0) {
+        std::cerr << "Error opening index file for reading." << std::endl;
+        return std::unique_ptr<EntrySource>();
+    }
+    EntrySource* cursor;
+    if (indexHeader.layout == kBTreeLayout) {
+        cursor = new LeafCursor(cursorFd, indexHeader);
+    } else if (indexHeader.layout == kFrontCodedLayout) {
+        cursor = new FrontCodedCursor(cursorFd, indexHeader, indexHeader.entriesOffset, 0);
+    } else if (indexHeader.layout == kEytzingerLayout) {
+        cursor = new EytzingerCursor(cursorFd, indexHeader);
+    } else if (indexHeader.layout == kTableLayout) {
+        cursor = new TableCursor(cursorFd, indexHeader);
+    } else if (indexHeader.layout == kColumnarLayout) {
+        cursor = new ColumnarCursor(cursorFd, indexHeader, withKeys);
+    } else {
+        cursor = new IndexCursor(cursorFd, indexHeader);
+    }
+    return std::unique_ptr<EntrySource>(cursor);
+}
+
+std::unique_ptr<EntrySource> IndexReader::storedEntriesFrom(const std::string& key) {
+    const size_t keyLength = indexHeader.keyLength;
+    const uint64_t count = indexHeader.entryCount;
+    std::string padded = key.substr(0, keyLength);
+    padded.resize(keyLength, '\0');
+    int cursorFd = dup(fd);
+    if (cursorFd < 0) {
+        std::cerr << "Error opening index file for reading." << std::endl;
+        return std::unique_ptr<EntrySource>();
+    }
+
+    EntrySource* cursor;
+    if (indexHeader.layout == kBTreeLayout) {
+        // Descend as a lookup does to the leaf that can hold the first entry not less than the key
+        const size_t itemSize = stride + sizeof(uint64_t);
+        uint64_t leaf = 0;
+        const char* node = root.data();
+        while (indexHeader.rootNode != kNoNode && loadLittleEndian(node, 4) > 0) {
+            uint64_t items = loadLittleEndian(node + 4, 4);
+            uint64_t position = lowerBoundEntry(node + kNodeHeaderSize, items, itemSize, padded.data(), keyLength);
+            leaf = loadLittleEndian(node + kNodeHeaderSize + (position > 0 ? position - 1 : 0) * itemSize + stride, 8);
+            node = readAt(indexHeader.entriesOffset + leaf * indexHeader.pageSize, page.data(), page.size());
+            if (node == nullptr) {
+                close(cursorFd);
+                return std::unique_ptr<EntrySource>();
+            }
+        }
+        cursor = new SkippingSource(new LeafCursor(cursorFd, indexHeader, leaf), padded);
+    } else if (indexHeader.layout == kFrontCodedLayout) {
+        // Decode from the start of the block that can hold the first entry not less than the key
+        const size_t itemSize = stride + sizeof(uint64_t);
+        uint64_t block = lowerBoundEntry(fences.data(), indexHeader.pageCount, itemSize, padded.data(), keyLength);
+        block = block > 0 ? block - 1 : 0;
+        uint64_t blockStart = block < indexHeader.pageCount ? loadLittleEndian(&fences[block * itemSize + stride], 8) : indexHeader.entriesOffset;
+        cursor = new SkippingSource(new FrontCodedCursor(cursorFd, indexHeader, blockStart, std::min(count, block * indexHeader.restartInterval)), padded);
+    } else if (indexHeader.layout == kEytzingerLayout) {
+        // The lookup ends at the first entry not less than the key; a cursor with no entries if there is none
+        const char* entry = count > 0 ? findEytzinger(padded.data()) : nullptr;
+        if (entry != nullptr) {
+            cursor = new EytzingerCursor(cursorFd, indexHeader, static_cast<uint64_t>(entry - (mapping + indexHeader.entriesOffset)) / stride + 1);
+        } else {
+            cursor = new IndexCursor(cursorFd, indexHeader, count);
+        }
+    } else {
+        // The entries of the flat, paged, learned and columnar layouts are reached by their position
+        uint64_t position = findLowerBound(padded.data()) != nullptr ? foundPosition : count;
+        if (indexHeader.layout == kColumnarLayout) {
+            cursor = new ColumnarCursor(cursorFd, indexHeader, true, position);
+        } else {
+            cursor = new IndexCursor(cursorFd, indexHeader, position);
+        }
+    }
+    return std::unique_ptr<EntrySource>(cursor);
+}
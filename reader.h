@@ -0,0 +1,198 @@
+/**
+ * Reading of index files: point lookups and sequential reads of the entries in every layout.
+ *
+ * Lookups in the flat layout binary search the entries with one read per probe. Lookups in the paged layout
+ * search the fence array, which is read once when the index is opened and kept in memory, and then read the
+ * single page that can hold the key. Lookups in the B+tree layout walk from the root, which is kept in memory,
+ * reading one node per level below it. Lookups in the front-coded layout search the block index, which is kept in
+ * memory, and decode the single block that can hold the key. The Eytzinger layout is mapped into memory and
+ * searched in place, prefetching the entries the next levels of the search will compare. Lookups in the learned
+ * layout predict the position of the key with the model, which is kept in memory, and read the entries within the
+ * error bound of the model around it. Lookups in the hash layout map the hash function into memory and read the
+ * one entry at the position it gives the key. The table layout is mapped into memory, and a lookup probes the slots
+ * from the one the hash of the key selects. The columnar layout is mapped into memory, and a lookup binary searches
+ * the first keys of the blocks of the key column and compares the key with a whole block of keys at once.
+ *
+ * The entries of the sorted layouts can also be read in order from the result of a search, for range queries.
+ *
+ * If the index has a key filter, every lookup first reads the one block of the filter that can hold the key, and
+ * most lookups of absent keys end there.
+ *
+ * An index opened mapped is mapped into memory whole, and lookups in every layout compare the keys in place in the
+ * mapping instead of reading the file: a lookup makes no system calls once the index is cached, and find and
+ * findEntry allocate nothing. findAll copies the entries of the key into the caller's buffer.
+*/
+#ifndef READER_H
+#define READER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "format.h"
+#include "mphf.h"
+#include "sort.h"
+
+/**
+ * An open index file.
+*/
+class IndexReader {
+public:
+    IndexReader();
+
+    /**
+     * Closes the index file.
+     */
+    ~IndexReader();
+
+    /**
+     * Open an index file and read its header and the sections kept in memory.
+     * Prints an error if the file cannot be read or is not a valid index file.
+     *
+     * @param indexFilename The name of the index file.
+     * @param mapped Whether to map the whole index into memory and search it in place rather than reading it.
+     * @return bool True if the index was opened, false otherwise.
+     */
+    bool open(const std::string& indexFilename, bool mapped = false);
+
+    /**
+     * Find the first entry with a key, in the order of the index.
+     *
+     * @param key The key to search for. Keys of a different length than the index keys are never found.
+     * @param offset Receives the offset of the record in the data file.
+     * @param length Receives the length of the record without its newline, kUnknownRecordLength if the index does
+     *               not know it.
+     * @return bool True if the key was found, false otherwise.
+     */
+    bool find(const std::string& key, std::streamoff& offset, uint32_t& length);
+
+    /**
+     * Find the first entry with a key, in the order of the index, as it is stored in the index file. Used to read
+     * the payloads of covering indexes (see loadStoredPayload).
+     *
+     * @param key The key to search for. Keys of a different length than the index keys are never found.
+     * @return const char* The stored entry, valid until the next lookup, or nullptr if the key was not found.
+     */
+    const char* findEntry(const std::string& key);
+
+    /**
+     * Find every entry with a key, in the order of the index, as they are stored in the index file. In the sorted
+     * layouts the entries of a key are next to each other, and are read on from where the search for the first of
+     * them ended: the positions after it, the rest of its B+tree leaf and the leaves after it, its front-coded block
+     * and the blocks after it, or its in-order successors in the Eytzinger layout. In the table layout they are the
+     * entry in the slot of the key and its run in the overflow area. The hash layout holds one entry per key.
+     *
+     * @param key The key to search for. Keys of a different length than the index keys are never found.
+     * @param entries Receives the stored entries of the key, storedEntryStride bytes each; none if the key was not
+     *                found. Its capacity is kept, so a buffer reused across searches stops allocating.
+     * @return bool True if the index could be read, false otherwise.
+     */
+    bool findAll(const std::string& key, std::vector<char>& entries);
+
+    /**
+     * Find every entry of each of many keys, as findAll does, as they are stored in the index file. The keys are
+     * searched in order: in the flat, paged, learned and columnar layouts, whose entries are reached by their
+     * position, every search gallops forward from the first entry the previous key found, probing 1, 2, 4, ...
+     * entries ahead, so keys close together in the index take a few probes each, and then reads the entries of the
+     * key that follow. The other layouts search every key on its own with findAll.
+     *
+     * @param keys The keys, sorted. Keys of a different length than the index keys are never found.
+     * @param entries Receives the stored entries of the keys, storedEntryStride bytes each, those of every key
+     *                together in the order of the keys.
+     * @param runs Receives the number of entries before those of every key, and the number of entries after the
+     *             last: the entries of key i are runs[i] to runs[i + 1], none if the key was not found.
+     * @return bool True if the index could be read, false otherwise.
+     */
+    bool findSorted(const std::vector<std::string>& keys, std::vector<char>& entries, std::vector<uint64_t>& runs);
+
+    /**
+     * Read the entries in sorted order, in their layout in memory (see entryStride). The entries of the hash layout
+     * are read in the order they are stored, and those of the table layout in the order of the slots of their keys,
+     * the entries of every key together; neither is sorted. The source reads the file independently of the
+     * reader and stays valid after the reader is destroyed.
+     *
+     * @param withKeys False if the keys are not needed: the columnar layout then reads only the column of offsets
+     *                 and lengths, and leaves the keys zeroed.
+     * @return std::unique_ptr<EntrySource> The entries, or an empty pointer if the file could not be reopened.
+     */
+    std::unique_ptr<EntrySource> entries(bool withKeys = true) const;
+
+    /**
+     * Read the entries in the order of entries(), as they are stored in the index file (see storedEntryStride).
+     *
+     * @param withKeys False if the keys are not needed (see entries).
+     * @return std::unique_ptr<EntrySource> The stored entries, or an empty pointer if the file could not be reopened.
+     */
+    std::unique_ptr<EntrySource> storedEntries(bool withKeys = true) const;
+
+    /**
+     * Read the stored entries in sorted order from the first whose key is not less than a key, after a search for
+     * that entry: the source reads only the entries from there on, as far as it is read. Only for sorted layouts
+     * (see isSortedLayout).
+     *
+     * @param key The key to start from. A key shorter than the index keys starts at the first key it is a prefix
+     *            of, or the first key greater than it.
+     * @return std::unique_ptr<EntrySource> The stored entries, or an empty pointer if the file could not be read.
+     */
+    std::unique_ptr<EntrySource> storedEntriesFrom(const std::string& key);
+
+    const IndexHeader& header() const { return indexHeader; }
+
+    /**
+     * @return size_t The number of reads from the index file made by lookups so far, for benchmarks.
+     */
+    size_t readCount() const { return reads; }
+
+private:
+    bool mapSection(uint64_t start, uint64_t length);
+    // Returns the bytes at a position of the file, in the mapping of a mapped index and read into the buffer
+    // otherwise, or nullptr if they could not be read
+    const char* readAt(uint64_t position, char* buffer, size_t length);
+    bool filterMayContain(const std::string& key);
+    const char* entryAt(uint64_t position);
+    // Returns the bytes of a block of the front-coded layout and sets their end, or nullptr if the block could not
+    // be read
+    const char* readFrontCodedBlock(uint64_t block, const char*& blockEnd);
+    // Returns the first stored entry whose key is not less than the key in any layout, or the entry of another key
+    // in the hash layout, nullptr if there is none
+    const char* findLowerBound(const char* key);
+    // Each returns the first stored entry whose key is not less than the key, nullptr if there is none
+    const char* findFlat(const char* key);
+    const char* findPaged(const char* key);
+    const char* findBTree(const char* key);
+    const char* findFrontCoded(const char* key);
+    const char* findEytzinger(const char* key);
+    const char* findLearned(const char* key);
+    const char* findHashed(const char* key);
+    const char* findInTable(const char* key);
+    const char* findColumnar(const char* key);
+
+    int fd;
+    IndexHeader indexHeader;
+    size_t stride;  // Size of a stored entry
+    std::vector<char> fences;
+    std::vector<char> root;
+    std::vector<char> page;
+    std::vector<char> candidate;
+    // Model of the learned layout
+    struct Segment {
+        uint64_t key;
+        uint64_t position;
+        double slope;
+    };
+    std::vector<Segment> segments;
+    std::vector<unsigned char> columns;
+    PerfectHash function;  // Hash function of the hash layout, in the mapping
+    const char* mapping;
+    size_t mappingLength;
+    bool mappedFile;  // Whether the mapping is the whole file
+    size_t reads;
+    // Where the last search ended, for the entries after the one it found: the position of the entry in the flat,
+    // paged, learned and columnar layouts, the leaf and the item in it in the B+tree layout, and the block in the
+    // front-coded layout
+    uint64_t foundPosition;
+    uint64_t foundNode;
+};
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * Scanning of the data file for index entries.
+ * See scan.h for an overview.
+*/
+#include "scan.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "newline.h"
+#include "sort.h"
+
+namespace {
+
+// Size of the blocks searched for newlines in a mapped file.
+const std::streamoff kScanBlockSize = 64 * 1024;
+// Size of the blocks read from files that cannot be mapped.
+const size_t kReadBlockSize = 1 << 20;
+// Smallest range scanned by its own thread.
+const std::streamoff kMinRangeSize = 1 << 20;
+
+/**
+ * Walk the records of a mapped data file in place, finding their boundaries a block at a time.
+ */
+bool scanMappedRange(const DataSource& source, std::streamoff begin, std::streamoff end, size_t keyLength, ExternalSorter& sorter) {
+    const char* base = source.data();
+    std::vector<uint32_t> newlines(kScanBlockSize);
+    std::streamoff recordStart = begin;
+
+    for (std::streamoff blockStart = begin; blockStart < end; blockStart += kScanBlockSize) {
+        size_t blockLength = static_cast<size_t>(std::min<std::streamoff>(kScanBlockSize, end - blockStart));
+        size_t count = findNewlines(base + blockStart, blockLength, newlines.data());
+
+        for (size_t i = 0; i < count; ++i) {
+            std::streamoff recordEnd = blockStart + newlines[i];
+            uint64_t recordLength = static_cast<uint64_t>(recordEnd - recordStart);
+            if (recordLength >= keyLength && !sorter.add(base + recordStart, recordStart, recordLength)) {
+                return false;
+            }
+            recordStart = recordEnd + 1;
+        }
+    }
+
+    // The last record of the file may have no newline
+    if (recordStart < end && static_cast<size_t>(end - recordStart) >= keyLength) {
+        return sorter.add(base + recordStart, recordStart, static_cast<uint64_t>(end - recordStart));
+    }
+    return true;
+}
+
+/**
+ * Read the records of an unmapped data file block by block, finding their boundaries the same way.
+ * Only the first keyLength bytes of a record that spans blocks are kept, so records longer than a block
+ * never need to be held in memory whole.
+ */
+bool scanBufferedRange(const DataSource& source, std::streamoff begin, std::streamoff end, size_t keyLength, ExternalSorter& sorter) {
+    std::vector<char> block(kReadBlockSize);
+    std::vector<uint32_t> newlines(kReadBlockSize);
+    std::vector<char> pendingKey(keyLength);  // Start of a record continued from an earlier block
+    uint64_t pendingLength = 0;  // Bytes of that record seen so far
+    std::streamoff recordStart = begin;
+
+    for (std::streamoff blockStart = begin; blockStart < end; ) {
+        size_t wanted = static_cast<size_t>(std::min<std::streamoff>(kReadBlockSize, end - blockStart));
+        long count = source.read(blockStart, block.data(), wanted);
+        if (count < 0) {
+            std::cerr << "Error reading data file." << std::endl;
+            return false;
+        }
+        if (count == 0) {
+            break;
+        }
+        size_t blockLength = static_cast<size_t>(count);
+        size_t newlineCount = findNewlines(block.data(), blockLength, newlines.data());
+
+        size_t segmentStart = 0;  // Start of the current record within the block
+        for (size_t i = 0; i < newlineCount; ++i) {
+            size_t segmentLength = newlines[i] - segmentStart;
+            if (pendingLength + segmentLength >= keyLength) {
+                const char* key = block.data() + segmentStart;
+                if (pendingLength > 0) {
+                    // Complete the key from this block
+                    size_t keyed = static_cast<size_t>(std::min<uint64_t>(pendingLength, keyLength));
+                    size_t copied = std::min(keyLength - keyed, segmentLength);
+                    std::memcpy(pendingKey.data() + keyed, key, copied);
+                    key = pendingKey.data();
+                }
+                if (!sorter.add(key, recordStart, pendingLength + segmentLength)) {
+                    return false;
+                }
+            }
+            recordStart = blockStart + newlines[i] + 1;
+            segmentStart = newlines[i] + 1;
+            pendingLength = 0;
+        }
+
+        // Carry the start of the unfinished record into the next block
+        size_t tailLength = blockLength - segmentStart;
+        if (pendingLength < keyLength) {
+            size_t copied = std::min(keyLength - static_cast<size_t>(pendingLength), tailLength);
+            std::memcpy(pendingKey.data() + pendingLength, block.data() + segmentStart, copied);
+        }
+        pendingLength += tailLength;
+        blockStart += static_cast<std::streamoff>(blockLength);
+    }
+
+    // The last record of the file may have no newline
+    if (pendingLength > 0 && pendingLength >= keyLength) {
+        return sorter.add(pendingKey.data(), recordStart, pendingLength);
+    }
+    return true;
+}
+
+} // namespace
+
+DataSource::DataSource() : fd(-1), mapping(nullptr), fileSize(-1), seekable(false) {
+}
+
+DataSource::~DataSource() {
+    if (mapping != nullptr) {
+        munmap(mapping, static_cast<size_t>(fileSize));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool DataSource::open(const std::string& filename) {
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        return false;
+    }
+
+    if (!S_ISREG(status.st_mode)) {
+        // Pipes and devices: read in order, size unknown
+        seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+        return true;
+    }
+
+    seekable = true;
+    fileSize = status.st_size;
+    if (fileSize > 0) {
+        void* address = mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            mapping = static_cast<char*>(address);
+            madvise(mapping, static_cast<size_t>(fileSize), MADV_SEQUENTIAL);
+        }
+    }
+    return true;
+}
+
+long DataSource::read(std::streamoff offset, char* buffer, size_t length) const {
+    for (;;) {
+        ssize_t count = seekable ? pread(fd, buffer, length, static_cast<off_t>(offset)) : ::read(fd, buffer, length);
+        if (count >= 0 || errno != EINTR) {
+            return static_cast<long>(count);
+        }
+    }
+}
+
+std::streamoff nextRecordStart(const DataSource& source, std::streamoff from) {
+    if (from <= 0 || from >= source.size()) {
+        return std::max<std::streamoff>(0, std::min(from, source.size()));
+    }
+
+    // A record starts at the offset if the byte before it is a newline, otherwise after the next newline
+    std::streamoff position = from - 1;
+
+    if (source.data() != nullptr) {
+        const char* newline = static_cast<const char*>(
+            std::memchr(source.data() + position, '\n', static_cast<size_t>(source.size() - position)));
+        return newline != nullptr ? newline - source.data() + 1 : source.size();
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    while (position < source.size()) {
+        long count = source.read(position, buffer.data(), buffer.size());
+        if (count <= 0) {
+            break;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(buffer.data(), '\n', static_cast<size_t>(count)));
+        if (newline != nullptr) {
+            return position + (newline - buffer.data()) + 1;
+        }
+        position += count;
+    }
+    return source.size();
+}
+
+std::streamoff unfinishedRecordStart(const DataSource& source, std::streamoff end) {
+    end = std::max<std::streamoff>(0, std::min(end, source.size()));
+
+    // Walk back from the end of the prefix to the newline before its last record
+    std::vector<char> buffer(source.data() != nullptr ? 0 : 64 * 1024);
+    for (std::streamoff blockEnd = end; blockEnd > 0; ) {
+        std::streamoff blockStart = std::max<std::streamoff>(0, blockEnd - 64 * 1024);
+        const char* block = buffer.data();
+        if (source.data() != nullptr) {
+            block = source.data() + blockStart;
+        } else if (source.read(blockStart, buffer.data(), static_cast<size_t>(blockEnd - blockStart)) != blockEnd - blockStart) {
+            return end;
+        }
+        const char* newline = static_cast<const char*>(memrchr(block, '\n', static_cast<size_t>(blockEnd - blockStart)));
+        if (newline != nullptr) {
+            return blockStart + (newline - block) + 1;
+        }
+        blockEnd = blockStart;
+    }
+    return 0;
+}
+
+std::vector<std::streamoff> splitAtRecordBoundaries(const DataSource& source, std::streamoff begin, size_t count) {
+    std::vector<std::streamoff> boundaries(1, begin);
+    if (source.size() < 0) {
+        boundaries.push_back(std::numeric_limits<std::streamoff>::max());
+        return boundaries;
+    }
+
+    for (size_t i = 1; i < count; ++i) {
+        std::streamoff splitPoint = begin + (source.size() - begin) * static_cast<std::streamoff>(i) / static_cast<std::streamoff>(count);
+        if (splitPoint <= boundaries.back()) {
+            continue;
+        }
+        std::streamoff boundary = nextRecordStart(source, splitPoint);
+        if (boundary >= source.size()) {
+            break;  // The last record spans the remaining split points
+        }
+        boundaries.push_back(boundary);
+    }
+
+    boundaries.push_back(source.size());
+    return boundaries;
+}
+
+bool scanRange(const DataSource& source, std::streamoff begin, std::streamoff end, size_t keyLength, ExternalSorter& sorter) {
+    if (source.data() != nullptr) {
+        return scanMappedRange(source, begin, end, keyLength, sorter);
+    }
+    return scanBufferedRange(source, begin, end, keyLength, sorter);
+}
+
+std::unique_ptr<ExternalSorter> scanDataFile(const DataSource& source, std::streamoff begin, size_t keyLength, const BuildOptions& options, const std::string& runPrefix) {
+    // Give every thread a range of at least kMinRangeSize bytes, so small files are scanned by one thread
+    std::streamoff length = source.size() >= 0 ? source.size() - begin : 0;
+    size_t rangeCount = std::min<size_t>(options.threads, std::max<std::streamoff>(1, length / kMinRangeSize));
+    std::vector<std::streamoff> boundaries = splitAtRecordBoundaries(source, begin, rangeCount);
+    rangeCount = boundaries.size() - 1;
+
+    // Each range gets its own sorter and an equal share of the memory budget
+    std::vector<std::unique_ptr<ExternalSorter> > sorters;
+    for (size_t i = 0; i < rangeCount; ++i) {
+        // Every indexed record holds at least keyLength bytes and a newline, which bounds the number of entries
+        // (streams of unknown size may fill the whole budget)
+        size_t maxEntries = source.size() >= 0 ? static_cast<size_t>(boundaries[i + 1] - boundaries[i]) / (keyLength + 1) + 1 : SIZE_MAX;
+        sorters.push_back(std::unique_ptr<ExternalSorter>(new ExternalSorter(
+            keyLength, options.memoryBudget / rangeCount, runPrefix + std::to_string(i) + "-", maxEntries, options.threads)));
+    }
+
+    // Scan the ranges in parallel
+    std::vector<char> scanned(rangeCount, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < rangeCount; ++i) {
+        threads.push_back(std::thread([&, i]() {
+            scanned[i] = scanRange(source, boundaries[i], boundaries[i + 1], keyLength, *sorters[i]);
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < rangeCount; ++i) {
+        if (!scanned[i]) {
+            return std::unique_ptr<ExternalSorter>();
+        }
+    }
+
+    // Combine the entries of all ranges into one sort
+    for (size_t i = 1; i < rangeCount; ++i) {
+        sorters[0]->absorb(*sorters[i]);
+    }
+    return std::move(sorters[0]);
+}
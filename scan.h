@@ -0,0 +1,133 @@
+/**
+ * Scanning of the data file for index entries.
+ *
+ * The data file is memory-mapped when possible and walked in place, so keys are read directly from the mapping and
+ * offsets follow from pointer arithmetic. Inputs that cannot be mapped, such as pipes, are read in large blocks
+ * with pread (or read when the input is not seekable).
+ *
+ * The data file is split into byte ranges that start and end on record boundaries, so that each range can be
+ * scanned independently by its own thread.
+*/
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "index.h"
+
+class ExternalSorter;
+
+/**
+ * Read-only access to a data file, memory-mapped when the file allows it.
+*/
+class DataSource {
+public:
+    DataSource();
+    ~DataSource();
+
+    /**
+     * Open the data file and map it into memory if it is a non-empty regular file.
+     *
+     * @param filename The name of the data file.
+     * @return bool False if the file could not be opened, true otherwise.
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @return const char* The start of the mapping, or nullptr if the file is not mapped.
+     */
+    const char* data() const { return mapping; }
+
+    /**
+     * @return std::streamoff The size of the file, or -1 if it is unknown (pipes and other streams).
+     */
+    std::streamoff size() const { return fileSize; }
+
+    /**
+     * @return bool True if reads may start at any offset, false if the input can only be read in order.
+     */
+    bool isSeekable() const { return seekable; }
+
+    /**
+     * Read bytes from an unmapped file into a buffer. Non-seekable inputs ignore the offset and continue
+     * where the previous read stopped.
+     *
+     * @param offset The file offset to read from.
+     * @param buffer The buffer receiving the bytes.
+     * @param length The maximum number of bytes to read.
+     * @return long The number of bytes read, 0 at the end of the file, or -1 on error.
+     */
+    long read(std::streamoff offset, char* buffer, size_t length) const;
+
+private:
+    DataSource(const DataSource&);
+    DataSource& operator=(const DataSource&);
+
+    int fd;
+    char* mapping;
+    std::streamoff fileSize;
+    bool seekable;
+};
+
+/**
+ * Find the start of the first record at or after an offset of a seekable data file.
+ *
+ * @param source The data file.
+ * @param from The offset to search from.
+ * @return std::streamoff The offset of the record, or the file size if no record starts after the offset.
+ */
+std::streamoff nextRecordStart(const DataSource& source, std::streamoff from);
+
+/**
+ * Find the start of the record that a prefix of a seekable data file ends in, so that a record cut short by the end
+ * of the prefix can be scanned again whole.
+ *
+ * @param source The data file.
+ * @param end The length of the prefix.
+ * @return std::streamoff The offset of the last record of the prefix if the prefix does not end with a newline,
+ *                        otherwise `end`.
+ */
+std::streamoff unfinishedRecordStart(const DataSource& source, std::streamoff end);
+
+/**
+ * Split the part of a data file from `begin` to its end into byte ranges aligned to record boundaries.
+ * Inputs of unknown size are returned as one range covering the whole stream.
+ *
+ * @param source The data file.
+ * @param begin The offset of the first record of the first range.
+ * @param count The number of ranges wanted. Fewer ranges are returned when records span several split points.
+ * @return std::vector<std::streamoff> The range boundaries: range i is [boundaries[i], boundaries[i + 1]).
+ */
+std::vector<std::streamoff> splitAtRecordBoundaries(const DataSource& source, std::streamoff begin, size_t count);
+
+/**
+ * Extract the key and offset of every record starting in [begin, end) and add them to the sorter.
+ * Records shorter than keyLength are skipped.
+ *
+ * @param source The data file.
+ * @param begin The offset of the first record in the range.
+ * @param end The offset just past the last record in the range.
+ * @param keyLength The length of the keys in the index file.
+ * @param sorter The sorter receiving the entries.
+ * @return bool False if the data file could not be read or the sorter failed, true otherwise.
+ */
+bool scanRange(const DataSource& source, std::streamoff begin, std::streamoff end, size_t keyLength, ExternalSorter& sorter);
+
+/**
+ * Scan the records of a data file from `begin` to its end in parallel ranges, one thread and one sorter per range,
+ * and combine the sorters into one.
+ *
+ * @param source The data file.
+ * @param begin The offset of the first record to scan.
+ * @param keyLength The length of the keys in the index file.
+ * @param options The memory budget and thread count for the scan; each range gets an equal share of the budget.
+ * @param runPrefix The path prefix used for temporary run files.
+ * @return std::unique_ptr<ExternalSorter> The sorter holding every entry, or nullptr if the scan failed.
+ */
+std::unique_ptr<ExternalSorter> scanDataFile(const DataSource& source, std::streamoff begin, size_t keyLength, const BuildOptions& options, const std::string& runPrefix);
+
+#endif
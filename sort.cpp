@@ -0,0 +1,527 @@
+/**
+ * Sorting of index entries within a fixed memory budget.
+ * See sort.h for an overview.
+*/
+#include "sort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <thread>
+
+namespace {
+
+// Largest number of runs merged in one pass; more runs are first merged into larger runs.
+const size_t kMaxMergeFanIn = 64;
+// Bounds on the read buffer given to each run during a merge.
+const size_t kMinRunBuffer = 64 * 1024;
+const size_t kMaxRunBuffer = 16 * 1024 * 1024;
+// Size of the buffer collecting merged entries before they are written.
+const size_t kMergeOutputBuffer = 1 << 20;
+// Buckets up to this size are sorted with insertion sort instead of another radix pass.
+const size_t kInsertionSortThreshold = 32;
+// Tables smaller than this are sorted on one thread.
+const size_t kParallelSortThreshold = 1 << 16;
+// Number of buckets per thread a parallel sort aims for, so that threads finishing early can take more work.
+const size_t kTasksPerThread = 8;
+
+/**
+ * Run a function on `threads` threads, one of them the calling thread, and wait for all of them.
+ */
+template <typename Function>
+void runOnThreads(size_t threads, Function function) {
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.push_back(std::thread(function));
+    }
+    function();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Radix digit of a packed entry: key byte `depth`, or for depth >= keyLength a byte of the offset,
+ * most significant first.
+ */
+inline unsigned entryDigit(const char* entry, size_t keyLength, size_t depth) {
+    if (depth < keyLength) {
+        return static_cast<unsigned char>(entry[depth]);
+    }
+    std::streamoff offset;
+    std::memcpy(&offset, entry + keyLength, sizeof(offset));
+    size_t shift = 8 * (sizeof(offset) - 1 - (depth - keyLength));
+    return static_cast<unsigned>((static_cast<unsigned long long>(offset) >> shift) & 0xFF);
+}
+
+/**
+ * Compare two packed entries whose first `depth` digits are known to be equal.
+ */
+inline bool entryLess(const char* a, const char* b, size_t keyLength, size_t depth) {
+    if (depth < keyLength) {
+        int order = std::memcmp(a + depth, b + depth, keyLength - depth);
+        if (order != 0) {
+            return order < 0;
+        }
+    }
+    std::streamoff offsetA, offsetB;
+    std::memcpy(&offsetA, a + keyLength, sizeof(offsetA));
+    std::memcpy(&offsetB, b + keyLength, sizeof(offsetB));
+    return offsetA < offsetB;
+}
+
+/**
+ * Insertion sort of a small bucket of packed entries.
+ */
+void insertionSortEntries(char* entries, size_t count, size_t keyLength, size_t depth, char* scratch) {
+    const size_t stride = entryStride(keyLength);
+    for (size_t i = 1; i < count; ++i) {
+        char* current = entries + i * stride;
+        size_t j = i;
+        while (j > 0 && entryLess(current, entries + (j - 1) * stride, keyLength, depth)) {
+            --j;
+        }
+        if (j != i) {
+            std::memcpy(scratch, current, stride);
+            std::memmove(entries + (j + 1) * stride, entries + j * stride, (i - j) * stride);
+            std::memcpy(entries + j * stride, scratch, stride);
+        }
+    }
+}
+
+/**
+ * Permute packed entries in place into 256 buckets by digit `depth` (one American flag sort pass).
+ *
+ * @param counts Receives the number of entries in each bucket.
+ * @return bool False if all entries share the digit, in which case nothing was moved.
+ */
+bool partitionEntries(char* entries, size_t count, size_t keyLength, size_t depth, char* scratch, size_t counts[256]) {
+    const size_t stride = entryStride(keyLength);
+
+    // Count the entries falling in each bucket
+    std::fill(counts, counts + 256, 0);
+    for (size_t i = 0; i < count; ++i) {
+        ++counts[entryDigit(entries + i * stride, keyLength, depth)];
+    }
+    if (counts[entryDigit(entries, keyLength, depth)] == count) {
+        return false;
+    }
+
+    // Swap every entry into the next free slot of its bucket
+    size_t next[256];
+    size_t end[256];
+    size_t position = 0;
+    for (int bucket = 0; bucket < 256; ++bucket) {
+        next[bucket] = position;
+        position += counts[bucket];
+        end[bucket] = position;
+    }
+    for (int bucket = 0; bucket < 256; ++bucket) {
+        while (next[bucket] < end[bucket]) {
+            char* entry = entries + next[bucket] * stride;
+            unsigned digit = entryDigit(entry, keyLength, depth);
+            if (digit == static_cast<unsigned>(bucket)) {
+                ++next[bucket];
+            } else {
+                char* target = entries + next[digit]++ * stride;
+                std::memcpy(scratch, target, stride);
+                std::memcpy(target, entry, stride);
+                std::memcpy(entry, scratch, stride);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * American flag sort of packed entries on digit `depth` and beyond.
+ */
+void radixSortBucket(char* entries, size_t count, size_t keyLength, size_t depth, char* scratch) {
+    const size_t stride = entryStride(keyLength);
+    // The record length after the offset is carried along but not sorted on
+    const size_t digits = keyLength + sizeof(std::streamoff);
+
+    while (depth < digits) {
+        if (count <= kInsertionSortThreshold) {
+            insertionSortEntries(entries, count, keyLength, depth, scratch);
+            return;
+        }
+
+        size_t counts[256];
+        if (!partitionEntries(entries, count, keyLength, depth, scratch, counts)) {
+            // All entries share this digit: move on to the next one
+            ++depth;
+            continue;
+        }
+
+        // Sort each bucket on the following digits
+        size_t bucketStart = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            if (counts[bucket] > 1) {
+                radixSortBucket(entries + bucketStart * stride, counts[bucket], keyLength, depth + 1, scratch);
+            }
+            bucketStart += counts[bucket];
+        }
+        return;
+    }
+}
+
+/**
+ * A bucket of packed entries still to be sorted from digit `depth` on.
+ */
+struct SortTask {
+    char* entries;
+    size_t count;
+    size_t depth;
+};
+
+/**
+ * Parallel MSD radix sort: buckets larger than an equal share of the work are partitioned on one thread until
+ * they are small enough, then the buckets are sorted independently by all threads, largest first.
+ */
+void parallelRadixSort(char* entries, size_t count, size_t keyLength, size_t threads) {
+    const size_t stride = entryStride(keyLength);
+    const size_t digits = keyLength + sizeof(std::streamoff);
+    const size_t taskLimit = std::max(count / (threads * kTasksPerThread), kInsertionSortThreshold);
+    std::vector<char> scratch(stride);
+
+    std::vector<SortTask> pending(1, SortTask{entries, count, 0});
+    std::vector<SortTask> tasks;
+    while (!pending.empty()) {
+        SortTask task = pending.back();
+        pending.pop_back();
+        if (task.count <= taskLimit || task.depth >= digits) {
+            tasks.push_back(task);
+            continue;
+        }
+
+        size_t counts[256];
+        if (!partitionEntries(task.entries, task.count, keyLength, task.depth, scratch.data(), counts)) {
+            pending.push_back(SortTask{task.entries, task.count, task.depth + 1});
+            continue;
+        }
+        char* bucketEntries = task.entries;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            if (counts[bucket] > 1) {
+                pending.push_back(SortTask{bucketEntries, counts[bucket], task.depth + 1});
+            }
+            bucketEntries += counts[bucket] * stride;
+        }
+    }
+
+    std::sort(tasks.begin(), tasks.end(), [](const SortTask& a, const SortTask& b) { return a.count > b.count; });
+    std::atomic<size_t> nextTask(0);
+    auto worker = [&]() {
+        std::vector<char> workerScratch(stride);
+        for (size_t i = nextTask++; i < tasks.size(); i = nextTask++) {
+            radixSortBucket(tasks[i].entries, tasks[i].count, keyLength, tasks[i].depth, workerScratch.data());
+        }
+    };
+    runOnThreads(std::min(threads, tasks.size()), worker);
+}
+
+/**
+ * Merge source over a sorted in-memory table.
+ */
+class TableSource : public EntrySource {
+public:
+    explicit TableSource(const EntryTable& table) : table(table), index(0), started(false) {
+    }
+    const char* head() const { return table.data() + index * table.stride(); }
+    bool next() {
+        index += started ? 1 : 0;
+        started = true;
+        return index < table.size();
+    }
+
+private:
+    const EntryTable& table;
+    size_t index;
+    bool started;
+};
+
+/**
+ * Merge source over a sorted run file, read through a large buffer.
+ */
+class RunSource : public EntrySource {
+public:
+    bool open(const std::string& filename, size_t bufferSize, size_t stride) {
+        buffer.resize(bufferSize);
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(filename, std::ifstream::binary);
+        entry.resize(stride);
+        return static_cast<bool>(file);
+    }
+    const char* head() const { return entry.data(); }
+    bool next() {
+        file.read(entry.data(), entry.size());
+        return static_cast<bool>(file);
+    }
+
+private:
+    std::ifstream file;
+    std::vector<char> buffer;
+    std::vector<char> entry;
+};
+
+/**
+ * Orders merge sources so that the priority queue yields the smallest head entry first.
+ */
+struct EntrySourceGreater {
+    const std::vector<std::unique_ptr<EntrySource> >* sources;
+    size_t keyLength;
+
+    bool operator()(size_t a, size_t b) const {
+        return compareEntries((*sources)[b]->head(), (*sources)[a]->head(), keyLength);
+    }
+};
+
+/**
+ * Merge sorted sources into the output stream with a k-way merge over their head entries.
+ */
+bool mergeSources(std::vector<std::unique_ptr<EntrySource> >& sources, size_t keyLength, EntrySink& out) {
+    const size_t stride = entryStride(keyLength);
+    EntrySourceGreater greater = { &sources, keyLength };
+    std::priority_queue<size_t, std::vector<size_t>, EntrySourceGreater> heap(greater);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i]->next()) {
+            heap.push(i);
+        }
+    }
+
+    std::vector<char> output;
+    output.reserve(kMergeOutputBuffer + stride);
+    while (!heap.empty()) {
+        size_t smallest = heap.top();
+        heap.pop();
+
+        const char* entry = sources[smallest]->head();
+        output.insert(output.end(), entry, entry + stride);
+        if (output.size() >= kMergeOutputBuffer) {
+            if (!out.write(output.data(), output.size() / stride)) {
+                return false;
+            }
+            output.clear();
+        }
+
+        if (sources[smallest]->next()) {
+            heap.push(smallest);
+        }
+    }
+    return out.write(output.data(), output.size() / stride);
+}
+
+/**
+ * Open sorted run files as merge sources, giving each run `bufferSize` bytes of read buffer.
+ */
+bool openRuns(const std::vector<std::string>& inputs, size_t keyLength, size_t bufferSize, std::vector<std::unique_ptr<EntrySource> >& sources) {
+    for (const auto& filename : inputs) {
+        RunSource* run = new RunSource();
+        sources.push_back(std::unique_ptr<EntrySource>(run));
+        if (!run->open(filename, bufferSize, entryStride(keyLength))) {
+            std::cerr << "Error opening sort run file " << filename << " for reading." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Read buffer size for each of `runCount` runs merged within the memory budget.
+ */
+size_t runBufferSize(size_t memoryBudget, size_t runCount) {
+    return std::min(std::max(memoryBudget / (runCount + 1), kMinRunBuffer), kMaxRunBuffer);
+}
+
+} // namespace
+
+bool compareIndexEntries(const IndexEntry& a, const IndexEntry& b) {
+    int order = a.key.compare(b.key);
+    return order < 0 || (order == 0 && a.offset < b.offset);
+}
+
+std::vector<char> packIndexEntries(const std::vector<IndexEntry>& entries, size_t keyLength) {
+    const size_t stride = entryStride(keyLength);
+    std::vector<char> packed(entries.size() * stride);
+    char* entry = packed.data();
+    for (const auto& source : entries) {
+        std::memcpy(entry, source.key.data(), keyLength);
+        std::memcpy(entry + keyLength, &source.offset, sizeof(source.offset));
+        std::memcpy(entry + keyLength + sizeof(source.offset), &kUnknownRecordLength, sizeof(kUnknownRecordLength));
+        entry += stride;
+    }
+    return packed;
+}
+
+void radixSortEntries(char* entries, size_t count, size_t keyLength, size_t threads) {
+    if (threads > 1 && count >= kParallelSortThreshold) {
+        parallelRadixSort(entries, count, keyLength, threads);
+        return;
+    }
+    std::vector<char> scratch(entryStride(keyLength));
+    radixSortBucket(entries, count, keyLength, 0, scratch.data());
+}
+
+void sortTables(std::vector<std::unique_ptr<EntryTable> >& tables, size_t threads) {
+    // Tables are sorted concurrently, and the threads left over are shared out for sorting within each table
+    size_t threadsPerTable = std::max<size_t>(1, threads / std::max<size_t>(1, tables.size()));
+    std::atomic<size_t> nextTable(0);
+    auto worker = [&]() {
+        for (size_t i = nextTable++; i < tables.size(); i = nextTable++) {
+            tables[i]->sort(threadsPerTable);
+        }
+    };
+    runOnThreads(std::max<size_t>(1, std::min(threads, tables.size())), worker);
+}
+
+EntryTable::EntryTable(size_t keyLength, size_t capacity)
+    : keyLength(keyLength), entrySize(entryStride(keyLength)), tableCapacity(capacity), count(0),
+      entries(new char[capacity * entryStride(keyLength)]) {
+}
+
+void EntryTable::sort(size_t threads) {
+    radixSortEntries(entries.get(), count, keyLength, threads);
+}
+
+ExternalSorter::ExternalSorter(size_t keyLength, size_t memoryBudget, const std::string& runPrefix, size_t maxEntries, size_t threads)
+    : keyLength(keyLength), memoryBudget(memoryBudget), threads(threads), runPrefix(runPrefix), runSerial(0),
+      spilledEntries(0), mergedEntries(0), longestRecord(0) {
+    size_t capacity = std::max<size_t>(1, memoryBudget / entryStride(keyLength));
+    tables.push_back(std::unique_ptr<EntryTable>(new EntryTable(keyLength, std::min(capacity, std::max<size_t>(1, maxEntries)))));
+}
+
+ExternalSorter::~ExternalSorter() {
+    for (const auto& filename : runFiles) {
+        std::remove(filename.c_str());
+    }
+}
+
+void ExternalSorter::absorb(ExternalSorter& other) {
+    // Keep this sorter's own table last, where add() expects it
+    for (auto& table : other.tables) {
+        tables.insert(tables.end() - 1, std::move(table));
+    }
+    other.tables.clear();
+    runFiles.insert(runFiles.end(), other.runFiles.begin(), other.runFiles.end());
+    other.runFiles.clear();
+    spilledEntries += other.spilledEntries;
+    other.spilledEntries = 0;
+    longestRecord = std::max(longestRecord, other.longestRecord);
+}
+
+std::string ExternalSorter::nextRunFilename() {
+    return runPrefix + std::to_string(runSerial++);
+}
+
+/**
+ * Write a sorted table to a new run file, leaving the table empty.
+ */
+bool ExternalSorter::spillTable(EntryTable& table) {
+    std::string filename = nextRunFilename();
+    std::ofstream runFile(filename, std::ofstream::binary);
+    runFiles.push_back(filename);
+    if (!runFile) {
+        std::cerr << "Error opening sort run file " << filename << " for writing." << std::endl;
+        return false;
+    }
+
+    runFile.write(table.data(), static_cast<std::streamsize>(table.size() * table.stride()));
+    spilledEntries += table.size();
+    table.clear();
+    runFile.close();
+    if (!runFile) {
+        std::cerr << "Error writing sort run file " << filename << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Sort and spill the table being filled, keeping its allocation for the next batch.
+ * Spills happen on the scanning thread that owns the sorter, so they use one thread.
+ */
+bool ExternalSorter::spill() {
+    tables.back()->sort(1);
+    return spillTable(*tables.back());
+}
+
+void ExternalSorter::mergeWith(std::unique_ptr<EntrySource> sorted, uint64_t count) {
+    sortedInputs.push_back(std::move(sorted));
+    mergedEntries += count;
+}
+
+uint64_t ExternalSorter::entryCount() const {
+    uint64_t count = spilledEntries + mergedEntries;
+    for (const auto& table : tables) {
+        count += table->size();
+    }
+    return count;
+}
+
+bool ExternalSorter::finish(EntrySink& out) {
+    sortTables(tables, threads);
+
+    // In-memory path: nothing was spilled, so write the sorted tables directly, merging if there are several
+    if (runFiles.empty()) {
+        if (tables.size() == 1 && sortedInputs.empty()) {
+            return out.write(tables[0]->data(), tables[0]->size());
+        }
+        std::vector<std::unique_ptr<EntrySource> > sources;
+        for (auto& table : tables) {
+            sources.push_back(std::unique_ptr<EntrySource>(new TableSource(*table)));
+        }
+        for (auto& input : sortedInputs) {
+            sources.push_back(std::move(input));
+        }
+        return mergeSources(sources, keyLength, out);
+    }
+
+    // External path: spill the remaining entries, then merge until the runs fit in a single pass
+    for (auto& table : tables) {
+        if (table->size() > 0 && !spillTable(*table)) {
+            return false;
+        }
+    }
+    tables.clear();
+
+    while (runFiles.size() + sortedInputs.size() > kMaxMergeFanIn) {
+        size_t fanIn = std::min(kMaxMergeFanIn, runFiles.size());
+        std::vector<std::string> inputs(runFiles.begin(), runFiles.begin() + fanIn);
+        std::string filename = nextRunFilename();
+        std::ofstream runFile(filename, std::ofstream::binary);
+        runFiles.push_back(filename);
+        std::vector<std::unique_ptr<EntrySource> > sources;
+        StreamSink runSink(runFile, entryStride(keyLength));
+        if (!runFile || !openRuns(inputs, keyLength, runBufferSize(memoryBudget, inputs.size()), sources) ||
+            !mergeSources(sources, keyLength, runSink)) {
+            std::cerr << "Error writing sort run file " << filename << "." << std::endl;
+            return false;
+        }
+        // The last entries are only written when the file is closed
+        runFile.close();
+        if (runFile.fail()) {
+            std::cerr << "Error writing sort run file " << filename << "." << std::endl;
+            return false;
+        }
+
+        for (const auto& input : inputs) {
+            std::remove(input.c_str());
+        }
+        runFiles.erase(runFiles.begin(), runFiles.begin() + fanIn);
+    }
+
+    // Final pass: the runs and the sorted inputs, each with an equal share of the memory budget as buffer
+    std::vector<std::unique_ptr<EntrySource> > sources;
+    if (!openRuns(runFiles, keyLength, runBufferSize(memoryBudget, runFiles.size() + sortedInputs.size()), sources)) {
+        return false;
+    }
+    for (auto& input : sortedInputs) {
+        sources.push_back(std::move(input));
+    }
+    return mergeSources(sources, keyLength, out);
+}
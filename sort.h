@@ -0,0 +1,321 @@
+/**
+ * Sorting of index entries within a fixed memory budget.
+ *
+ * Entries are packed into an EntryTable in the layout of the index file, without any per-entry allocation.
+ * If every entry fits in the budget, the table is radix sorted and written in one pass. Otherwise each full table
+ * is sorted and spilled to a temporary run file, and the runs are combined with a k-way merge when the index is
+ * written.
+*/
+#ifndef SORT_H
+#define SORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "index.h"
+
+/**
+ * Sorted sequence of packed index entries, read one entry at a time.
+ * A source starts before its first entry: next() must be called before head().
+*/
+class EntrySource {
+public:
+    virtual ~EntrySource() {}
+
+    /**
+     * @return const char* The current entry, valid until the next call to next().
+     */
+    virtual const char* head() const = 0;
+
+    /**
+     * Advance to the next entry.
+     *
+     * @return bool False if there are no more entries, true otherwise.
+     */
+    virtual bool next() = 0;
+};
+
+/**
+ * Receiver of packed index entries in sorted order, such as an index file writer.
+*/
+class EntrySink {
+public:
+    virtual ~EntrySink() {}
+
+    /**
+     * Append entries. Entries are passed in order over any number of calls.
+     *
+     * @param entries The packed entries.
+     * @param count The number of entries.
+     * @return bool False if the entries could not be written, true otherwise.
+     */
+    virtual bool write(const char* entries, size_t count) = 0;
+};
+
+/**
+ * Sink writing packed entries back to back to a stream, the layout of sort run files.
+*/
+class StreamSink : public EntrySink {
+public:
+    StreamSink(std::ostream& out, size_t stride) : out(out), stride(stride) {}
+
+    bool write(const char* entries, size_t count) {
+        out.write(entries, static_cast<std::streamsize>(count * stride));
+        return out.good();
+    }
+
+private:
+    std::ostream& out;
+    size_t stride;
+};
+
+/**
+ * Source passing on the entries of another source whose records start before an offset of the data file.
+*/
+class OffsetLimitSource : public EntrySource {
+public:
+    OffsetLimitSource(std::unique_ptr<EntrySource> source, size_t keyLength, std::streamoff limit)
+        : source(std::move(source)), keyLength(keyLength), limit(limit) {}
+
+    const char* head() const { return source->head(); }
+
+    bool next() {
+        while (source->next()) {
+            std::streamoff offset;
+            std::memcpy(&offset, source->head() + keyLength, sizeof(offset));
+            if (offset < limit) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::unique_ptr<EntrySource> source;
+    size_t keyLength;
+    std::streamoff limit;
+};
+
+/**
+ * Fixed-capacity table of packed index entries.
+ * Each entry is keyLength key bytes followed by the offset and the length of the record in host byte order
+ * (see entryStride), and the entries are stored back to back in one allocation made when the table is created.
+*/
+class EntryTable {
+public:
+    /**
+     * @param keyLength The length of the keys in the index file.
+     * @param capacity The number of entries the table can hold. Memory is only committed as entries are added.
+     */
+    EntryTable(size_t keyLength, size_t capacity);
+
+    /**
+     * Append an entry. The table must not be full.
+     *
+     * @param key The first keyLength bytes of the record.
+     * @param offset The offset of the record in the data file.
+     * @param length The length of the record, without its newline.
+     */
+    void add(const char* key, std::streamoff offset, uint32_t length) {
+        char* entry = entries.get() + count * entrySize;
+        std::memcpy(entry, key, keyLength);
+        std::memcpy(entry + keyLength, &offset, sizeof(offset));
+        std::memcpy(entry + keyLength + sizeof(offset), &length, sizeof(length));
+        ++count;
+    }
+
+    /**
+     * Sort the entries in place by key, then by offset (see radixSortEntries).
+     *
+     * @param threads The number of threads to sort with.
+     */
+    void sort(size_t threads);
+
+    /**
+     * Remove all entries, keeping the allocation.
+     */
+    void clear() { count = 0; }
+
+    const char* data() const { return entries.get(); }
+    size_t size() const { return count; }
+    size_t stride() const { return entrySize; }
+    bool full() const { return count == tableCapacity; }
+
+private:
+    size_t keyLength;
+    size_t entrySize;
+    size_t tableCapacity;
+    size_t count;
+    std::unique_ptr<char[]> entries;
+};
+
+/**
+ * Collects index entries and writes them in sorted order, spilling sorted runs to disk when they do not fit in memory.
+*/
+class ExternalSorter {
+public:
+    /**
+     * @param keyLength The length of the keys in the index file.
+     * @param memoryBudget The number of bytes the collected entries may occupy before they are spilled to a run file.
+     * @param runPrefix The path prefix used for temporary run files.
+     * @param maxEntries An upper bound on the number of entries that will be added, used to size the table.
+     * @param threads The number of threads sorting the entries when the sorter finishes.
+     */
+    ExternalSorter(size_t keyLength, size_t memoryBudget, const std::string& runPrefix, size_t maxEntries, size_t threads);
+
+    /**
+     * Removes any run files that are still on disk.
+     */
+    ~ExternalSorter();
+
+    /**
+     * Add an entry, spilling the collected entries to a run file first if the table is full.
+     *
+     * @param key The first keyLength bytes of the record.
+     * @param offset The offset of the record in the data file.
+     * @param length The length of the record, without its newline. Records of 4 GiB or more are stored with
+     *               kUnknownRecordLength.
+     * @return bool False if a run file could not be written, true otherwise.
+     */
+    bool add(const char* key, std::streamoff offset, uint64_t length) {
+        if (tables.back()->full() && !spill()) {
+            return false;
+        }
+        uint32_t stored = length < kUnknownRecordLength ? static_cast<uint32_t>(length) : kUnknownRecordLength;
+        if (stored > longestRecord) {
+            longestRecord = stored;
+        }
+        tables.back()->add(key, offset, stored);
+        return true;
+    }
+
+    /**
+     * Pass every added entry to the sink in sorted order.
+     * The tables still in memory are sorted in parallel first.
+     *
+     * @param out The sink receiving the index entries.
+     * @return bool False if a run file could not be read or written or the sink failed, true otherwise.
+     */
+    bool finish(EntrySink& out);
+
+    /**
+     * Merge the entries of an existing sorted source, such as an index file, into the output when the sorter
+     * finishes. The source is read sequentially.
+     *
+     * @param sorted The entries in sorted order.
+     * @param count The number of entries in the source.
+     */
+    void mergeWith(std::unique_ptr<EntrySource> sorted, uint64_t count);
+
+    /**
+     * Take over the entries and run files of another sorter, leaving it empty.
+     * Used to combine the sorters filled by several scanning threads before finishing. The tables are kept
+     * separate and merged when the sorter finishes, so no entries are copied.
+     *
+     * @param other The sorter to take the entries from.
+     */
+    void absorb(ExternalSorter& other);
+
+    /**
+     * @return size_t The number of run files spilled so far.
+     */
+    size_t runCount() const { return runFiles.size(); }
+
+    /**
+     * @return uint64_t The number of entries the sorter will pass on when it finishes.
+     */
+    uint64_t entryCount() const;
+
+    /**
+     * @return uint32_t The largest record length added so far, kUnknownRecordLength if a record was too long to
+     *                  store. Entries of sources passed to mergeWith are not included.
+     */
+    uint32_t maxRecordLength() const { return longestRecord; }
+
+    /**
+     * @return size_t The number of threads the sorter sorts with, which writers may use as well.
+     */
+    size_t threadCount() const { return threads; }
+
+    /**
+     * @return const std::string& The path prefix of the run files, under which writers may put temporary files.
+     */
+    const std::string& filePrefix() const { return runPrefix; }
+
+private:
+    bool spill();
+    bool spillTable(EntryTable& table);
+    std::string nextRunFilename();
+
+    size_t keyLength;
+    size_t memoryBudget;
+    size_t threads;
+    std::string runPrefix;
+    size_t runSerial;
+    std::vector<std::unique_ptr<EntryTable> > tables;
+    std::vector<std::string> runFiles;
+    std::vector<std::unique_ptr<EntrySource> > sortedInputs;
+    uint64_t spilledEntries;
+    uint64_t mergedEntries;
+    uint32_t longestRecord;
+};
+
+/**
+ * Compare two packed index entries by key, then by offset.
+ *
+ * @param a The first packed entry.
+ * @param b The second packed entry.
+ * @param keyLength The length of the keys in the index file.
+ * @return bool True if the first entry sorts before the second entry, false otherwise.
+ */
+inline bool compareEntries(const char* a, const char* b, size_t keyLength) {
+    int order = std::memcmp(a, b, keyLength);
+    if (order != 0) {
+        return order < 0;
+    }
+    std::streamoff offsetA, offsetB;
+    std::memcpy(&offsetA, a + keyLength, sizeof(offsetA));
+    std::memcpy(&offsetB, b + keyLength, sizeof(offsetB));
+    return offsetA < offsetB;
+}
+
+/**
+ * Pack index entries into the layout used while sorting: fixed-length keys followed by their offsets and an
+ * unknown record length.
+ *
+ * @param entries The entries to pack.
+ * @param keyLength The length of the keys in the index file.
+ * @return std::vector<char> The packed entries, entryStride(keyLength) bytes each.
+ */
+std::vector<char> packIndexEntries(const std::vector<IndexEntry>& entries, size_t keyLength);
+
+/**
+ * Sort packed index entries in place by key, then by offset.
+ *
+ * Sorting approach: MSD radix sort (American flag sort) over the key bytes and then the offset bytes from the most
+ * significant down, so the order matches compareEntries. Buckets of at most 32 entries are finished with
+ * insertion sort. With several threads, large buckets are partitioned first and the resulting buckets are
+ * sorted in parallel; the result does not depend on the thread count.
+ *
+ * @param entries The packed entries.
+ * @param count The number of entries.
+ * @param keyLength The length of the keys in the index file.
+ * @param threads The number of threads to sort with.
+ */
+void radixSortEntries(char* entries, size_t count, size_t keyLength, size_t threads = 1);
+
+/**
+ * Sort several tables with a shared pool of threads: tables are sorted concurrently, and each table is sorted
+ * with its share of the threads.
+ *
+ * @param tables The tables to sort.
+ * @param threads The number of threads to sort with.
+ */
+void sortTables(std::vector<std::unique_ptr<EntryTable> >& tables, size_t threads);
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * Open-addressing hash table of the keys of an index, for the table layout.
+ *
+ * The table is a power-of-two array of slots. Every slot holds a 16-bit fingerprint of its key (0 in empty slots),
+ * the first entry of the key, and the run of the key's further entries in the overflow area: the position of the
+ * first of them plus one (0 if there are none) and their number, each overflowWidth bytes. A key starts probing at
+ * the slot the high bits of its hash select and moves on one slot at a time, wrapping around, until it finds its
+ * fingerprint and key, or an empty slot. The table is at most kMaxTableLoad full, so runs of full slots stay short
+ * and a probe usually ends in the cache line it started in.
+ *
+ * In indexes with aligned entries the fingerprint is padded to 8 bytes and the overflow fields take 8 bytes, so the
+ * entries of the slots stay aligned.
+*/
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "filter.h"
+#include "format.h"
+
+// Size of the fingerprint at the start of every slot.
+const size_t kFingerprintSize = 2;
+// Largest share of the slots holding a key.
+const double kMaxTableLoad = 0.75;
+
+/**
+ * Number of slots of a table of keys: the smallest power of two keeping the table at most kMaxTableLoad full.
+ *
+ * @param keyCount The number of distinct keys.
+ * @return uint64_t The number of slots, which leaves at least one slot empty.
+ */
+inline uint64_t tableSlotCount(uint64_t keyCount) {
+    uint64_t slots = 1;
+    while (static_cast<double>(slots) * kMaxTableLoad < static_cast<double>(keyCount)) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+/**
+ * Smallest width of the overflow fields of the slots: 0 if no key has more than one entry.
+ *
+ * @param overflowCount The number of entries in the overflow area.
+ * @return uint32_t The number of bytes needed to store any position plus one or number of entries of the area.
+ */
+inline uint32_t overflowWidthFor(uint64_t overflowCount) {
+    uint32_t width = 0;
+    while (width < 8 && overflowCount >> (8 * width) != 0) {
+        ++width;
+    }
+    return width;
+}
+
+/**
+ * Position of the entry within a slot of the table, after the fingerprint and any padding.
+ *
+ * @param header The header of the index file.
+ * @return size_t The position in bytes from the start of the slot.
+ */
+inline size_t slotEntryPosition(const IndexHeader& header) {
+    return header.flags & kAlignedEntries ? 8 : kFingerprintSize;
+}
+
+/**
+ * Size of a slot of the table.
+ *
+ * @param header The header of the index file.
+ * @return size_t The size of a slot in bytes.
+ */
+inline size_t tableSlotSize(const IndexHeader& header) {
+    return slotEntryPosition(header) + storedEntryStride(header) + 2 * header.overflowWidth;
+}
+
+/**
+ * Slot a key starts probing at: the high bits of its hash.
+ *
+ * @param hash The hash of the key (see hashKey).
+ * @param slotCount The number of slots, a power of two.
+ * @return uint64_t The slot number.
+ */
+inline uint64_t tableHome(uint64_t hash, uint64_t slotCount) {
+    return slotCount > 1 ? hash >> __builtin_clzll(slotCount - 1) : 0;
+}
+
+/**
+ * Fingerprint of a key: the low bits of its hash, never 0.
+ *
+ * @param hash The hash of the key (see hashKey).
+ * @return uint16_t The fingerprint.
+ */
+inline uint16_t tableFingerprint(uint64_t hash) {
+    uint16_t fingerprint = static_cast<uint16_t>(hash);
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+#endif
@@ -0,0 +1,1007 @@
+/**
+ * Writing of index files.
+ * See writer.h for an overview.
+*/
+#include "writer.h"
+
+#include "filter.h"
+#include "mphf.h"
+#include "projection.h"
+#include "table.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Size of the buffer collecting pages before they are written.
+const size_t kPageOutputBuffer = 1 << 20;
+// Size of the buffer of each level of the Eytzinger layout.
+const size_t kLevelBuffer = 64 * 1024;
+// Size of the part of the entries of the hash layout that is placed in memory at a time.
+const size_t kHashPlacementBuffer = 256 << 20;
+
+/**
+ * Sink converting entries from their layout in memory to their layout in the index file before passing them on to
+ * the writer of a layout, a batch at a time. The keys are added to the key filter on the way, if there is one, and
+ * the payloads of a covering index are projected from the records in the mapping of the data file.
+ */
+class EncodingSink : public EntrySink {
+public:
+    EncodingSink(EntrySink& out, const IndexHeader& header, std::vector<char>& filter, const char* data, uint64_t dataSize)
+        : out(out), header(header), filter(filter), data(data), dataSize(dataSize), entrySize(entryStride(header.keyLength)),
+          storedSize(storedEntryStride(header)), batchSize(std::max<size_t>(1, kPageOutputBuffer / entrySize)), batch(batchSize * storedSize) {
+    }
+
+    bool write(const char* entries, size_t count) {
+        const uint64_t filterBlocks = filter.size() / kFilterBlockSize;
+        while (count > 0) {
+            size_t batchCount = std::min(count, batchSize);
+            for (size_t i = 0; i < batchCount; ++i) {
+                encodeIndexEntry(entries + i * entrySize, &batch[i * storedSize], header);
+                if (header.projection.payloadWidth > 0) {
+                    project(entries + i * entrySize);
+                    encodePayload(projected, &batch[i * storedSize], header);
+                }
+                if (filterBlocks > 0) {
+                    uint64_t hash = hashKey(entries + i * entrySize, header.keyLength);
+                    addToFilterBlock(&filter[filterBlock(hash, filterBlocks) * kFilterBlockSize], hash, header.filterHashes);
+                }
+            }
+            if (!out.write(batch.data(), batchCount)) {
+                return false;
+            }
+            entries += batchCount * entrySize;
+            count -= batchCount;
+        }
+        return true;
+    }
+
+private:
+    /**
+     * Project the record of an entry, reading up to the newline if the entry does not know its length.
+     */
+    void project(const char* entry) {
+        std::streamoff offset;
+        uint32_t length;
+        std::memcpy(&offset, entry + header.keyLength, sizeof(offset));
+        std::memcpy(&length, entry + header.keyLength + sizeof(offset), sizeof(length));
+        const char* record = data + offset;
+        size_t recordLength = length;
+        if (length == kUnknownRecordLength) {
+            const char* newline = static_cast<const char*>(std::memchr(record, '\n', static_cast<size_t>(dataSize - offset)));
+            recordLength = newline != nullptr ? static_cast<size_t>(newline - record) : static_cast<size_t>(dataSize - offset);
+        }
+        projectRecord(record, recordLength, header.projection, projected);
+    }
+
+    EntrySink& out;
+    const IndexHeader& header;
+    std::vector<char>& filter;
+    const char* data;
+    uint64_t dataSize;
+    size_t entrySize;
+    size_t storedSize;
+    size_t batchSize;
+    std::vector<char> batch;
+    std::string projected;
+};
+
+/**
+ * Writer of the paged layout: whole entries packed into fixed-size pages, and the first entry of every page
+ * collected for the fence array written after the pages.
+ */
+class PagedWriter : public EntrySink {
+public:
+    PagedWriter(std::ostream& out, size_t stride, size_t pageSize)
+        : out(out), stride(stride), pageSize(pageSize), entriesPerPage(pageSize / stride), pageFill(0), pageCount(0), entryCount(0) {
+        output.reserve(kPageOutputBuffer + pageSize);
+    }
+
+    bool write(const char* entries, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const char* entry = entries + i * stride;
+            if (pageFill == 0) {
+                // Start a page padded with zeros, and remember its first entry as a fence
+                output.resize(output.size() + pageSize, 0);
+                fences.insert(fences.end(), entry, entry + stride);
+                ++pageCount;
+            }
+            std::memcpy(&output[output.size() - pageSize + pageFill * stride], entry, stride);
+            ++entryCount;
+            if (++pageFill == entriesPerPage) {
+                pageFill = 0;
+                if (output.size() >= kPageOutputBuffer && !flush()) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Write the last page and the fence array, and record the entry count and their positions in the header.
+     */
+    bool finish(IndexHeader& header) {
+        if (!flush()) {
+            return false;
+        }
+        header.entryCount = entryCount;
+        header.pageSize = static_cast<uint32_t>(pageSize);
+        header.pageCount = pageCount;
+        header.fenceOffset = header.entriesOffset + pageCount * pageSize;
+        out.write(fences.data(), static_cast<std::streamsize>(fences.size()));
+        return out.good();
+    }
+
+private:
+    bool flush() {
+        out.write(output.data(), static_cast<std::streamsize>(output.size()));
+        output.clear();
+        return out.good();
+    }
+
+    std::ostream& out;
+    size_t stride;
+    size_t pageSize;
+    size_t entriesPerPage;
+    size_t pageFill;  // Entries in the last page of the output buffer
+    uint64_t pageCount;
+    uint64_t entryCount;
+    std::vector<char> output;
+    std::vector<char> fences;
+};
+
+/**
+ * Writer of the B+tree layout, built bottom-up: the leaves are filled and written as the sorted entries arrive,
+ * keeping the first entry of every leaf, and the inner levels are built from those when the entries end.
+ * Every node records its item count, so nodes need not be full.
+ */
+class BTreeWriter : public EntrySink {
+public:
+    BTreeWriter(std::ostream& out, size_t stride, size_t nodeSize)
+        : out(out), stride(stride), nodeSize(nodeSize), entriesPerLeaf((nodeSize - kNodeHeaderSize) / stride),
+          leafFill(0), leafCount(0), entryCount(0) {
+        output.reserve(kPageOutputBuffer + nodeSize);
+    }
+
+    bool write(const char* entries, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const char* entry = entries + i * stride;
+            if (leafFill == entriesPerLeaf || leafCount == 0) {
+                // Link the full leaf to the next one, then start the next leaf
+                if (leafCount > 0) {
+                    closeLeaf(leafCount);
+                    if (output.size() >= kPageOutputBuffer && !flush()) {
+                        return false;
+                    }
+                }
+                output.resize(output.size() + nodeSize, 0);
+                separators.insert(separators.end(), entry, entry + stride);
+                ++leafCount;
+                leafFill = 0;
+            }
+            std::memcpy(&output[output.size() - nodeSize + kNodeHeaderSize + leafFill * stride], entry, stride);
+            ++leafFill;
+            ++entryCount;
+        }
+        return true;
+    }
+
+    /**
+     * Write the last leaf and the inner levels, and record the shape of the tree in the header.
+     */
+    bool finish(IndexHeader& header) {
+        header.entryCount = entryCount;
+        header.pageSize = static_cast<uint32_t>(nodeSize);
+        header.pageCount = leafCount;
+        header.rootNode = leafCount > 0 ? 0 : kNoNode;
+        header.treeHeight = leafCount > 0 ? 1 : 0;
+        if (leafCount == 0) {
+            return true;
+        }
+        closeLeaf(kNoNode);
+
+        // Each pass groups the nodes of one level under the nodes of the level above, until one node remains
+        const size_t itemSize = stride + sizeof(uint64_t);
+        const size_t itemsPerNode = (nodeSize - kNodeHeaderSize) / itemSize;
+        uint64_t firstChild = 0;
+        uint64_t childCount = leafCount;
+        uint64_t nextNode = leafCount;
+        for (uint32_t level = 1; childCount > 1; ++level) {
+            std::vector<char> parents;
+            uint64_t parentCount = 0;
+            for (uint64_t child = 0; child < childCount; child += itemsPerNode) {
+                size_t items = static_cast<size_t>(std::min<uint64_t>(itemsPerNode, childCount - child));
+                if (output.size() >= kPageOutputBuffer && !flush()) {
+                    return false;
+                }
+                output.resize(output.size() + nodeSize, 0);
+                char* node = &output[output.size() - nodeSize];
+                storeLittleEndian(node, level, 4);
+                storeLittleEndian(node + 4, items, 4);
+                storeLittleEndian(node + 8, kNoNode, 8);
+                for (size_t i = 0; i < items; ++i) {
+                    char* item = node + kNodeHeaderSize + i * itemSize;
+                    std::memcpy(item, &separators[static_cast<size_t>(child + i) * stride], stride);
+                    storeLittleEndian(item + stride, firstChild + child + i, 8);
+                }
+                parents.insert(parents.end(), node + kNodeHeaderSize, node + kNodeHeaderSize + stride);
+                ++parentCount;
+            }
+            separators.swap(parents);
+            firstChild = nextNode;
+            childCount = parentCount;
+            nextNode += parentCount;
+            header.treeHeight = level + 1;
+        }
+        header.rootNode = firstChild;
+        return flush();
+    }
+
+private:
+    /**
+     * Record the item count and the next leaf in the header of the leaf being filled.
+     */
+    void closeLeaf(uint64_t nextLeaf) {
+        char* node = &output[output.size() - nodeSize];
+        storeLittleEndian(node, 0, 4);
+        storeLittleEndian(node + 4, leafFill, 4);
+        storeLittleEndian(node + 8, nextLeaf, 8);
+    }
+
+    bool flush() {
+        out.write(output.data(), static_cast<std::streamsize>(output.size()));
+        output.clear();
+        return out.good();
+    }
+
+    std::ostream& out;
+    size_t stride;
+    size_t nodeSize;
+    size_t entriesPerLeaf;
+    size_t leafFill;  // Entries in the leaf at the end of the output buffer
+    uint64_t leafCount;
+    uint64_t entryCount;
+    std::vector<char> output;
+    std::vector<char> separators;  // First entry of every node of the level being built
+};
+
+/**
+ * Writer of the front-coded layout: each key is stored as the length of the prefix it shares with the key before
+ * it and the remaining bytes, restarting every restartInterval entries. The first entry and file offset of every
+ * block are collected for the block index written after the blocks.
+ */
+class FrontCodedWriter : public EntrySink {
+public:
+    FrontCodedWriter(std::ostream& out, size_t keyLength, size_t stride, uint64_t entriesOffset, uint32_t restartInterval)
+        : out(out), keyLength(keyLength), stride(stride), restartInterval(restartInterval),
+          position(entriesOffset), entryCount(0), blockCount(0), previousKey(keyLength) {
+        output.reserve(kPageOutputBuffer + stride + 10);
+    }
+
+    bool write(const char* entries, size_t count) {
+        char encoded[10];
+        for (size_t i = 0; i < count; ++i) {
+            const char* entry = entries + i * stride;
+            size_t shared = 0;
+            if (entryCount % restartInterval == 0) {
+                // Restart: the entry is stored whole and indexed
+                blockIndex.insert(blockIndex.end(), entry, entry + stride);
+                char blockPosition[8];
+                storeLittleEndian(blockPosition, position + output.size(), sizeof(blockPosition));
+                blockIndex.insert(blockIndex.end(), blockPosition, blockPosition + sizeof(blockPosition));
+                ++blockCount;
+            } else {
+                while (shared < keyLength && entry[shared] == previousKey[shared]) {
+                    ++shared;
+                }
+            }
+            size_t length = storeVarint(encoded, shared);
+            output.insert(output.end(), encoded, encoded + length);
+            output.insert(output.end(), entry + shared, entry + stride);
+            std::memcpy(previousKey.data(), entry, keyLength);
+            ++entryCount;
+
+            if (output.size() >= kPageOutputBuffer && !flush()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Write the block index, and record the entry count and its position in the header.
+     */
+    bool finish(IndexHeader& header) {
+        if (!flush()) {
+            return false;
+        }
+        header.entryCount = entryCount;
+        header.restartInterval = restartInterval;
+        header.pageCount = blockCount;
+        header.fenceOffset = position;
+        out.write(blockIndex.data(), static_cast<std::streamsize>(blockIndex.size()));
+        return out.good();
+    }
+
+private:
+    bool flush() {
+        out.write(output.data(), static_cast<std::streamsize>(output.size()));
+        position += output.size();
+        output.clear();
+        return out.good();
+    }
+
+    std::ostream& out;
+    size_t keyLength;
+    size_t stride;
+    uint32_t restartInterval;
+    uint64_t position;  // File offset of the start of the output buffer
+    uint64_t entryCount;
+    uint64_t blockCount;
+    std::vector<char> previousKey;
+    std::vector<char> output;
+    std::vector<char> blockIndex;
+};
+
+/**
+ * Writer of the Eytzinger layout. The sorted entries are placed at the positions of an in-order walk of the tree,
+ * which visits each level in increasing position order, so every level is written sequentially from its own
+ * buffer. The number of entries must be known in advance to shape the tree.
+ */
+class EytzingerWriter : public EntrySink {
+public:
+    EytzingerWriter(std::ostream& out, size_t stride, uint64_t entriesOffset, uint64_t count)
+        : out(out), stride(stride), entriesOffset(entriesOffset), count(count), written(0),
+          position(firstEytzingerPosition(count)), levelCapacity(std::max<size_t>(1, kLevelBuffer / stride)) {
+        for (uint64_t levelStart = 1; levelStart <= count; levelStart *= 2) {
+            levels.push_back(Level());
+            levels.back().start = levelStart;
+        }
+    }
+
+    bool write(const char* entries, size_t entryCount) {
+        for (size_t i = 0; i < entryCount; ++i) {
+            if (position == 0) {
+                return false;  // More entries than announced
+            }
+            Level& level = levels[63 - __builtin_clzll(position)];
+            if (level.buffer.empty()) {
+                level.start = position;
+            }
+            level.buffer.insert(level.buffer.end(), entries + i * stride, entries + (i + 1) * stride);
+            if (level.buffer.size() >= levelCapacity * stride && !flush(level)) {
+                return false;
+            }
+            position = nextEytzingerPosition(position, count);
+            ++written;
+        }
+        return true;
+    }
+
+    /**
+     * Write the entries still buffered, and check that every position was filled.
+     */
+    bool finish(IndexHeader& header) {
+        for (auto& level : levels) {
+            if (!flush(level)) {
+                return false;
+            }
+        }
+        header.entryCount = written;
+        return written == count && out.good();
+    }
+
+private:
+    struct Level {
+        uint64_t start;  // Position of the first buffered entry
+        std::vector<char> buffer;
+    };
+
+    bool flush(Level& level) {
+        if (level.buffer.empty()) {
+            return true;
+        }
+        out.seekp(static_cast<std::streamoff>(entriesOffset + (level.start - 1) * stride));
+        out.write(level.buffer.data(), static_cast<std::streamsize>(level.buffer.size()));
+        level.buffer.clear();
+        return out.good();
+    }
+
+    std::ostream& out;
+    size_t stride;
+    uint64_t entriesOffset;
+    uint64_t count;
+    uint64_t written;
+    uint64_t position;  // Position of the next entry
+    size_t levelCapacity;
+    std::vector<Level> levels;
+};
+
+/**
+ * Writer of the columnar layout. The keys and the rest of the entries are collected in two buffers, each written
+ * sequentially to its column; the number of entries must be known in advance to place the value column.
+ */
+class ColumnarWriter : public EntrySink {
+public:
+    ColumnarWriter(std::ostream& out, const IndexHeader& header, uint64_t count)
+        : out(out), keyLength(header.keyLength), valuePosition(storedOffsetPosition(header)), stride(storedEntryStride(header)),
+          keysPerBlock(columnKeysPerBlock(header.keyLength)), blockSize(columnBlockSize(header.keyLength)),
+          valuesOffset(header.entriesOffset + (count + keysPerBlock - 1) / keysPerBlock * blockSize), count(count), written(0),
+          keysEnd(header.entriesOffset), valuesEnd(valuesOffset) {
+        keys.reserve(kPageOutputBuffer + blockSize);
+        values.reserve(kPageOutputBuffer + stride);
+    }
+
+    bool write(const char* entries, size_t entryCount) {
+        for (size_t i = 0; i < entryCount; ++i) {
+            const char* entry = entries + i * stride;
+            if (written == count) {
+                return false;  // More entries than announced
+            }
+            if (written % keysPerBlock == 0) {
+                keys.resize(keys.size() + blockSize, 0);
+            }
+            std::memcpy(&keys[keys.size() - blockSize + written % keysPerBlock * keyLength], entry, keyLength);
+            values.insert(values.end(), entry + valuePosition, entry + stride);
+            ++written;
+            if ((keys.size() >= kPageOutputBuffer || values.size() >= kPageOutputBuffer) && !flush()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Write the entries still buffered, check that every entry was written, and record the position of the value
+     * column in the header.
+     */
+    bool finish(IndexHeader& header) {
+        if (!flush()) {
+            return false;
+        }
+        header.entryCount = written;
+        header.fenceOffset = valuesOffset;
+        return written == count;
+    }
+
+private:
+    /**
+     * Write the whole blocks of keys and all values collected so far at the end of their columns.
+     */
+    bool flush() {
+        // A block still being filled stays in the buffer, unless it is the last
+        size_t wholeBlocks = keys.size() - (written % keysPerBlock != 0 && written < count ? blockSize : 0);
+        out.seekp(static_cast<std::streamoff>(keysEnd));
+        out.write(keys.data(), static_cast<std::streamsize>(wholeBlocks));
+        out.seekp(static_cast<std::streamoff>(valuesEnd));
+        out.write(values.data(), static_cast<std::streamsize>(values.size()));
+        keysEnd += wholeBlocks;
+        valuesEnd += values.size();
+        keys.erase(keys.begin(), keys.begin() + static_cast<std::ptrdiff_t>(wholeBlocks));
+        values.clear();
+        return out.good();
+    }
+
+    std::ostream& out;
+    size_t keyLength;
+    size_t valuePosition;  // Position of the offset within a stored entry
+    size_t stride;
+    size_t keysPerBlock;
+    size_t blockSize;
+    uint64_t valuesOffset;
+    uint64_t count;
+    uint64_t written;
+    uint64_t keysEnd;  // File offset of the first block of the key buffer
+    uint64_t valuesEnd;  // File offset of the first value of the value buffer
+    std::vector<char> keys;
+    std::vector<char> values;
+};
+
+/**
+ * Writer of the learned layout. The entries are written back to back while the range of the bytes at every key
+ * position is collected; the model is then fitted in a second pass over the written entries, once the mapping of
+ * keys to numbers is known, and written after them.
+ *
+ * Fitting: every distinct mapped key is a point (key, position of its first entry). A segment grows point by point
+ * while some line through its first point passes within modelError of every point: the range of slopes of such
+ * lines narrows with each point, and when it becomes empty the point starts a new segment (the shrinking cone
+ * method of FITing-Tree). The slope of a segment is the middle of its range.
+ */
+class LearnedWriter : public EntrySink {
+public:
+    LearnedWriter(std::iostream& file, size_t keyLength, size_t stride, uint64_t entriesOffset, uint32_t modelError)
+        : file(file), keyLength(keyLength), stride(stride), entriesOffset(entriesOffset), modelError(modelError),
+          entryCount(0), columns(2 * keyLength) {
+        for (size_t i = 0; i < keyLength; ++i) {
+            columns[2 * i] = 255;
+            columns[2 * i + 1] = 0;
+        }
+        output.reserve(kPageOutputBuffer + stride);
+    }
+
+    bool write(const char* entries, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const unsigned char* key = reinterpret_cast<const unsigned char*>(entries + i * stride);
+            for (size_t j = 0; j < keyLength; ++j) {
+                columns[2 * j] = std::min(columns[2 * j], key[j]);
+                columns[2 * j + 1] = std::max(columns[2 * j + 1], key[j]);
+            }
+        }
+        output.insert(output.end(), entries, entries + count * stride);
+        entryCount += count;
+        return output.size() < kPageOutputBuffer || flush();
+    }
+
+    /**
+     * Fit the model over the written entries and write it after them, and record its shape in the header.
+     */
+    bool finish(IndexHeader& header) {
+        if (!flush()) {
+            return false;
+        }
+
+        // Map as many leading key positions as the 64-bit mapped keys can hold
+        size_t keyColumns = 0;
+        uint64_t combinations = 1;
+        for (; keyColumns < keyLength && entryCount > 0; ++keyColumns) {
+            uint64_t radix = static_cast<uint64_t>(columns[2 * keyColumns + 1]) - columns[2 * keyColumns] + 1;
+            if (combinations > UINT64_MAX / radix) {
+                break;
+            }
+            combinations *= radix;
+        }
+        std::vector<char> model(columns.begin(), columns.begin() + 2 * keyColumns);
+
+        // Second pass: fit the segments over the entries as written
+        std::vector<char> buffer(std::max(kPageOutputBuffer / stride, static_cast<size_t>(1)) * stride);
+        const unsigned char* ranges = columns.data();
+        const double error = modelError;
+        uint64_t segmentKey = 0, segmentPosition = 0;
+        double lowSlope = 0, highSlope = 0;
+        uint64_t previousKey = 0;
+        uint64_t segmentCount = 0;
+        file.seekg(static_cast<std::streamoff>(entriesOffset));
+        for (uint64_t position = 0; position < entryCount; ) {
+            size_t count = static_cast<size_t>(std::min<uint64_t>(buffer.size() / stride, entryCount - position));
+            if (!file.read(buffer.data(), static_cast<std::streamsize>(count * stride))) {
+                return false;
+            }
+            for (size_t i = 0; i < count; ++i, ++position) {
+                uint64_t key = learnedKeyValue(&buffer[i * stride], ranges, keyColumns);
+                if (position > 0 && key == previousKey) {
+                    continue;  // Only the first entry of equal mapped keys is a point
+                }
+                previousKey = key;
+                if (position > 0) {
+                    double distance = static_cast<double>(key - segmentKey);
+                    double rise = static_cast<double>(position - segmentPosition);
+                    double low = std::max(lowSlope, (rise - error) / distance);
+                    double high = std::min(highSlope, (rise + error) / distance);
+                    if (low <= high) {
+                        lowSlope = low;
+                        highSlope = high;
+                        continue;
+                    }
+                    appendSegment(model, segmentKey, segmentPosition, lowSlope, highSlope);
+                    ++segmentCount;
+                }
+                segmentKey = key;
+                segmentPosition = position;
+                lowSlope = 0;
+                highSlope = std::numeric_limits<double>::infinity();
+            }
+        }
+        if (entryCount > 0) {
+            appendSegment(model, segmentKey, segmentPosition, lowSlope, highSlope);
+            ++segmentCount;
+        }
+
+        header.entryCount = entryCount;
+        header.modelError = modelError;
+        header.keyColumns = static_cast<uint32_t>(keyColumns);
+        header.pageCount = segmentCount;
+        header.fenceOffset = entriesOffset + entryCount * stride;
+        file.seekp(static_cast<std::streamoff>(header.fenceOffset));
+        file.write(model.data(), static_cast<std::streamsize>(model.size()));
+        return file.good();
+    }
+
+private:
+    /**
+     * Append a segment to the model, with the slope in the middle of the range of slopes that fit its points.
+     */
+    static void appendSegment(std::vector<char>& model, uint64_t key, uint64_t position, double lowSlope, double highSlope) {
+        double slope = highSlope == std::numeric_limits<double>::infinity() ? lowSlope : (lowSlope + highSlope) / 2;
+        uint64_t slopeBits;
+        std::memcpy(&slopeBits, &slope, sizeof(slopeBits));
+        char segment[kSegmentSize];
+        storeLittleEndian(segment, key, 8);
+        storeLittleEndian(segment + 8, position, 8);
+        storeLittleEndian(segment + 16, slopeBits, 8);
+        model.insert(model.end(), segment, segment + sizeof(segment));
+    }
+
+    bool flush() {
+        file.write(output.data(), static_cast<std::streamsize>(output.size()));
+        output.clear();
+        return file.good();
+    }
+
+    std::iostream& file;
+    size_t keyLength;
+    size_t stride;
+    uint64_t entriesOffset;
+    uint32_t modelError;
+    uint64_t entryCount;
+    std::vector<unsigned char> columns;  // Smallest and largest byte seen at every key position
+    std::vector<char> output;
+};
+
+/**
+ * Writer of the hash layout, which holds one entry per key: a key on several records fails the index. The entries
+ * are kept in a temporary file, in key order, while the hashes of the keys are collected in memory, 8 bytes per key. When the entries end, the hash function is built over
+ * the hashes and the entries are placed at their positions, one part of the index at a time: the part is filled in
+ * memory and written in order. With several parts, the entries are first sent to one temporary file per part, so
+ * every file is read sequentially and once.
+ */
+class HashWriter : public EntrySink {
+public:
+    HashWriter(std::ostream& out, size_t keyLength, size_t stride, const std::string& scratchPrefix, size_t threads)
+        : out(out), keyLength(keyLength), stride(stride), scratchPrefix(scratchPrefix), threads(threads),
+          entryCount(0), previousKey(keyLength) {
+        output.reserve(kPageOutputBuffer + stride);
+    }
+
+    /**
+     * Removes the temporary files.
+     */
+    ~HashWriter() {
+        scratch.close();
+        for (const auto& filename : scratchFiles) {
+            std::remove(filename.c_str());
+        }
+    }
+
+    bool write(const char* entries, size_t count) {
+        if (!scratch.is_open() && !openScratch(scratch, scratchPrefix + "hash")) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const char* entry = entries + i * stride;
+            if (entryCount > 0 && std::memcmp(entry, previousKey.data(), keyLength) == 0) {
+                std::cerr << "Error: the key " << std::string(entry, keyLength) << " is on more than one record, and the hash layout holds one record per key. Use another layout, such as --layout table." << std::endl;
+                return false;
+            }
+            std::memcpy(previousKey.data(), entry, keyLength);
+            output.insert(output.end(), entry, entry + stride);
+            hashes.push_back(hashKey(entry, keyLength));
+            ++entryCount;
+        }
+        return output.size() < kPageOutputBuffer || flush();
+    }
+
+    /**
+     * Build the hash function, write the entries at their positions followed by the function, and record the entry
+     * count and the position of the function in the header.
+     */
+    bool finish(IndexHeader& header) {
+        if (scratch.is_open() && !flush()) {
+            return false;
+        }
+        uint32_t levels = 0;
+        std::vector<char> stored = buildPerfectHash(hashes, threads, levels);
+        PerfectHash function;
+        function.open(stored.data(), stored.size(), levels);
+
+        // Keys without a position at any level take the last positions, in key order
+        uint64_t nextUnplaced = function.placedCount();
+        auto positionOf = [&](const char* entry) {
+            uint64_t position = function.slot(hashKey(entry, keyLength));
+            return position < function.placedCount() ? position : nextUnplaced++;
+        };
+
+        const uint64_t partEntries = std::max<size_t>(1, kHashPlacementBuffer / stride);
+        const uint64_t partCount = (entryCount + partEntries - 1) / partEntries;
+        std::vector<char> part(static_cast<size_t>(std::min(entryCount, partEntries)) * stride);
+        std::vector<char> buffer(std::max<size_t>(1, kPageOutputBuffer / stride) * (sizeof(uint64_t) + stride));
+        if (partCount == 1) {
+            // Place the entries straight from the temporary file
+            scratch.seekg(0);
+            for (uint64_t done = 0; done < entryCount; ) {
+                size_t count = static_cast<size_t>(std::min<uint64_t>(buffer.size() / stride, entryCount - done));
+                if (!scratch.read(buffer.data(), static_cast<std::streamsize>(count * stride))) {
+                    return false;
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    std::memcpy(&part[static_cast<size_t>(positionOf(&buffer[i * stride])) * stride], &buffer[i * stride], stride);
+                }
+                done += count;
+            }
+            out.write(part.data(), static_cast<std::streamsize>(part.size()));
+        } else if (partCount > 1 && !placeByParts(positionOf, partEntries, partCount, part, buffer)) {
+            return false;
+        }
+
+        header.entryCount = entryCount;
+        header.pageCount = levels;
+        header.fenceOffset = header.entriesOffset + entryCount * stride;
+        out.write(stored.data(), static_cast<std::streamsize>(stored.size()));
+        return out.good();
+    }
+
+private:
+    /**
+     * Send every entry, preceded by its position, to the temporary file of its part, then fill and write the parts
+     * in order from their files.
+     */
+    template <typename PositionOf>
+    bool placeByParts(PositionOf& positionOf, uint64_t partEntries, uint64_t partCount, std::vector<char>& part, std::vector<char>& buffer) {
+        const size_t itemSize = sizeof(uint64_t) + stride;
+        std::vector<std::fstream> parts(static_cast<size_t>(partCount));
+        for (size_t i = 0; i < parts.size(); ++i) {
+            if (!openScratch(parts[i], scratchPrefix + "hash" + std::to_string(i))) {
+                return false;
+            }
+        }
+
+        scratch.seekg(0);
+        char item[sizeof(uint64_t)];
+        for (uint64_t done = 0; done < entryCount; ) {
+            size_t count = static_cast<size_t>(std::min<uint64_t>(buffer.size() / stride, entryCount - done));
+            if (!scratch.read(buffer.data(), static_cast<std::streamsize>(count * stride))) {
+                return false;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t position = positionOf(&buffer[i * stride]);
+                std::memcpy(item, &position, sizeof(item));
+                std::fstream& file = parts[static_cast<size_t>(position / partEntries)];
+                file.write(item, sizeof(item));
+                file.write(&buffer[i * stride], static_cast<std::streamsize>(stride));
+            }
+            done += count;
+        }
+
+        for (uint64_t partIndex = 0; partIndex < partCount; ++partIndex) {
+            std::fstream& file = parts[static_cast<size_t>(partIndex)];
+            uint64_t first = partIndex * partEntries;
+            uint64_t count = std::min(partEntries, entryCount - first);
+            file.seekg(0);
+            for (uint64_t done = 0; done < count; ) {
+                size_t items = static_cast<size_t>(std::min<uint64_t>(buffer.size() / itemSize, count - done));
+                if (!file.read(buffer.data(), static_cast<std::streamsize>(items * itemSize))) {
+                    return false;
+                }
+                for (size_t i = 0; i < items; ++i) {
+                    uint64_t position;
+                    std::memcpy(&position, &buffer[i * itemSize], sizeof(position));
+                    std::memcpy(&part[static_cast<size_t>(position - first) * stride], &buffer[i * itemSize + sizeof(position)], stride);
+                }
+                done += items;
+            }
+            file.close();
+            out.write(part.data(), static_cast<std::streamsize>(count * stride));
+        }
+        return out.good();
+    }
+
+    /**
+     * Create a temporary file, removed when the writer is destroyed.
+     */
+    bool openScratch(std::fstream& file, const std::string& filename) {
+        scratchFiles.push_back(filename);
+        file.open(filename, std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
+        return file.is_open();
+    }
+
+    bool flush() {
+        scratch.write(output.data(), static_cast<std::streamsize>(output.size()));
+        output.clear();
+        return scratch.good();
+    }
+
+    std::ostream& out;
+    size_t keyLength;
+    size_t stride;
+    std::string scratchPrefix;
+    size_t threads;
+    uint64_t entryCount;
+    std::vector<char> previousKey;
+    std::vector<char> output;
+    std::vector<uint64_t> hashes;
+    std::fstream scratch;  // Entries, in key order
+    std::vector<std::string> scratchFiles;
+};
+
+/**
+ * Writer of the table layout. The further entries of every key are written to the overflow area as they arrive,
+ * and the first entry of every key is kept in memory with the position of its run of further entries. When the
+ * entries end, the number of keys sizes the table, which is filled in memory and written after the overflow area.
+ * The first entries and the table are held in memory whatever the memory budget of the sorter (see BuildOptions).
+ */
+class TableWriter : public EntrySink {
+public:
+    TableWriter(std::ostream& out, size_t keyLength, size_t stride)
+        : out(out), keyLength(keyLength), stride(stride), overflowCount(0) {
+        output.reserve(kPageOutputBuffer + stride);
+    }
+
+    bool write(const char* entries, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const char* entry = entries + i * stride;
+            if (!runStarts.empty() && std::memcmp(entry, &firsts[firsts.size() - stride], keyLength) == 0) {
+                output.insert(output.end(), entry, entry + stride);
+                ++overflowCount;
+            } else {
+                firsts.insert(firsts.end(), entry, entry + stride);
+                runStarts.push_back(overflowCount);
+            }
+        }
+        return output.size() < kPageOutputBuffer || flush();
+    }
+
+    /**
+     * Fill the table and write it after the overflow area, and record its shape in the header.
+     */
+    bool finish(IndexHeader& header) {
+        if (!flush()) {
+            return false;
+        }
+        const uint64_t keyCount = runStarts.size();
+        header.overflowWidth = header.flags & kAlignedEntries && overflowCount > 0 ? 8 : overflowWidthFor(overflowCount);
+        header.pageCount = tableSlotCount(keyCount);
+        header.entryCount = keyCount + overflowCount;
+        header.fenceOffset = header.entriesOffset + overflowCount * stride;
+        runStarts.push_back(overflowCount);
+
+        const size_t slotSize = tableSlotSize(header);
+        const size_t entryPosition = slotEntryPosition(header);
+        const uint64_t mask = header.pageCount - 1;
+        std::vector<char> table(static_cast<size_t>(header.pageCount) * slotSize, 0);
+        for (uint64_t key = 0; key < keyCount; ++key) {
+            const char* entry = &firsts[static_cast<size_t>(key) * stride];
+            uint64_t hash = hashKey(entry, keyLength);
+            uint64_t slot = tableHome(hash, header.pageCount);
+            while (loadLittleEndian(&table[static_cast<size_t>(slot) * slotSize], kFingerprintSize) != 0) {
+                slot = (slot + 1) & mask;
+            }
+            char* stored = &table[static_cast<size_t>(slot) * slotSize];
+            uint64_t runLength = runStarts[key + 1] - runStarts[key];
+            storeLittleEndian(stored, tableFingerprint(hash), kFingerprintSize);
+            std::memcpy(stored + entryPosition, entry, stride);
+            storeLittleEndian(stored + entryPosition + stride, runLength > 0 ? runStarts[key] + 1 : 0, header.overflowWidth);
+            storeLittleEndian(stored + entryPosition + stride + header.overflowWidth, runLength, header.overflowWidth);
+        }
+        out.write(table.data(), static_cast<std::streamsize>(table.size()));
+        return out.good();
+    }
+
+private:
+    bool flush() {
+        out.write(output.data(), static_cast<std::streamsize>(output.size()));
+        output.clear();
+        return out.good();
+    }
+
+    std::ostream& out;
+    size_t keyLength;
+    size_t stride;
+    uint64_t overflowCount;
+    std::vector<char> output;
+    std::vector<char> firsts;  // First entry of every key, in key order
+    std::vector<uint64_t> runStarts;  // Position in the overflow area of the further entries of every key
+};
+
+} // namespace
+
+bool writeIndex(std::fstream& indexFile, ExternalSorter& sorter, IndexHeader& header, const char* data, uint64_t dataSize) {
+    const size_t stride = storedEntryStride(header);
+    const size_t pageSize = header.pageSize > 0 ? header.pageSize : kIndexPageSize;
+    if ((header.layout == kPagedLayout && stride > pageSize) ||
+        (header.layout == kBTreeLayout && kNodeHeaderSize + 2 * (stride + sizeof(uint64_t)) > pageSize) ||
+        (header.layout == kColumnarLayout && header.keyLength == 0)) {
+        header.layout = kFlatLayout;
+    }
+    if (header.projection.payloadWidth > 0 && data == nullptr && sorter.entryCount() > 0) {
+        return false;  // The payloads are projected from the data file
+    }
+
+    // Size the key filter for every entry, duplicates included
+    std::vector<char> filter;
+    header.filterOffset = 0;
+    header.filterBlocks = 0;
+    header.filterHashes = 0;
+    // The hash layouts answer a lookup of an absent key with no more reads than a filter would take
+    if (header.filterBitsPerKey > 0 && sorter.entryCount() > 0 && header.layout != kHashLayout && header.layout != kTableLayout) {
+        header.filterBlocks = (sorter.entryCount() * header.filterBitsPerKey + kFilterBlockSize * 8 - 1) / (kFilterBlockSize * 8);
+        header.filterHashes = filterHashCount(header.filterBitsPerKey);
+        filter.resize(static_cast<size_t>(header.filterBlocks) * kFilterBlockSize, 0);
+    }
+    if (!writeIndexHeader(indexFile, header)) {
+        return false;
+    }
+
+    if (header.layout == kPagedLayout) {
+        PagedWriter writer(indexFile, stride, pageSize);
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kBTreeLayout) {
+        BTreeWriter writer(indexFile, stride, pageSize);
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kEytzingerLayout) {
+        header.pageSize = 0;
+        EytzingerWriter writer(indexFile, stride, header.entriesOffset, sorter.entryCount());
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kColumnarLayout) {
+        header.pageSize = 0;
+        ColumnarWriter writer(indexFile, header, sorter.entryCount());
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kLearnedLayout) {
+        header.pageSize = 0;
+        LearnedWriter writer(indexFile, header.keyLength, stride, header.entriesOffset, kModelError);
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kHashLayout) {
+        header.pageSize = 0;
+        HashWriter writer(indexFile, header.keyLength, stride, sorter.filePrefix(), sorter.threadCount());
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kTableLayout) {
+        header.pageSize = 0;
+        TableWriter writer(indexFile, header.keyLength, stride);
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else if (header.layout == kFrontCodedLayout) {
+        header.pageSize = 0;
+        FrontCodedWriter writer(indexFile, header.keyLength, stride, header.entriesOffset, kRestartInterval);
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder) || !writer.finish(header)) {
+            return false;
+        }
+    } else {
+        header.pageSize = 0;
+        StreamSink writer(indexFile, stride);
+        EncodingSink encoder(writer, header, filter, data, dataSize);
+        if (!sorter.finish(encoder)) {
+            return false;
+        }
+        std::streamoff entriesLength = static_cast<std::streamoff>(indexFile.tellp()) - static_cast<std::streamoff>(header.entriesOffset);
+        header.entryCount = static_cast<uint64_t>(entriesLength) / stride;
+    }
+
+    // The filter goes after every section of the layout, aligned to its blocks
+    if (!filter.empty()) {
+        indexFile.seekp(0, std::ios::end);
+        uint64_t end = static_cast<uint64_t>(static_cast<std::streamoff>(indexFile.tellp()));
+        header.filterOffset = (end + kFilterBlockSize - 1) / kFilterBlockSize * kFilterBlockSize;
+        std::vector<char> padding(static_cast<size_t>(header.filterOffset - end), 0);
+        indexFile.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        indexFile.write(filter.data(), static_cast<std::streamsize>(filter.size()));
+    }
+
+    indexFile.seekp(0);
+    return writeIndexHeader(indexFile, header);
+}
@@ -0,0 +1,37 @@
+/**
+ * Writing of index files.
+ *
+ * The sorted entries produced by an ExternalSorter are written after the header in the layout chosen in the
+ * header (see format.h), followed by any sections the layout needs. The header is rewritten at the end, once the
+ * number of entries and the positions of the sections are known.
+*/
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <fstream>
+
+#include "format.h"
+#include "sort.h"
+
+/**
+ * Write an index file: the header, the sorted entries in the layout of the header, and the sections of the layout.
+ * Layouts that cannot hold the entries (pages smaller than one entry, nodes smaller than two) fall back to the
+ * flat layout. The page size of the header is used for the paged and B+tree layouts, kIndexPageSize if it is zero.
+ * If the header has a filterBitsPerKey, a key filter of that size is written after the sections of the layout,
+ * except in the hash and table layouts. The hash layout places its entries through temporary files named after the run files
+ * of the sorter, and builds its hash function with the threads of the sorter. The payloads of covering indexes are
+ * projected from the records in a mapping of the data file as the entries are written, so the entries are sorted
+ * without them.
+ *
+ * @param indexFile The index file, opened for reading and writing at its start. The learned layout reads back the
+ *                  entries it wrote to fit its model.
+ * @param sorter The sorter holding the entries.
+ * @param header The header to write. Its offset and record length widths must hold every entry of the sorter.
+ *               Its entry count, layout and section fields are filled in.
+ * @param data The mapping of the data file, needed if the header has a projection.
+ * @param dataSize The size of the data file.
+ * @return bool False if the index file could not be written, true otherwise.
+ */
+bool writeIndex(std::fstream& indexFile, ExternalSorter& sorter, IndexHeader& header, const char* data = nullptr, uint64_t dataSize = 0);
+
+#endif